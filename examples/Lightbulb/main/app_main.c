@@ -111,7 +111,8 @@ static void InitializePlatform() {
     HAPPlatformTCPStreamManagerCreate(&platform.tcpStreamManager, &(const HAPPlatformTCPStreamManagerOptions) {
         /* Listen on all available network interfaces. */
         .port = 0 /* Listen on unused port number from the ephemeral port range. */,
-        .maxConcurrentTCPStreams = 9
+        .maxConcurrentTCPStreams = 9,
+        .batchAccept = true /* Accept all pending connections in a single run loop iteration. */
     });
 
     // Service discovery.
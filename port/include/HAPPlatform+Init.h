@@ -25,6 +25,8 @@
 extern "C" {
 #endif
 
+#include "sdkconfig.h"
+
 /**
  * Optional features set in Makefile.
  */
@@ -42,6 +44,24 @@ extern "C" {
 #else
 #define HAVE_MFI_HW_AUTH 0
 #endif
+
+#ifdef CONFIG_HAP_RUN_LOOP_STATISTICS
+#define HAVE_RUN_LOOP_STATISTICS 1
+#else
+#define HAVE_RUN_LOOP_STATISTICS 0
+#endif
+
+#ifdef CONFIG_HAP_RUN_LOOP_WATCHDOG
+#define HAVE_RUN_LOOP_WATCHDOG 1
+#else
+#define HAVE_RUN_LOOP_WATCHDOG 0
+#endif
+
+#ifdef CONFIG_HAP_VIRTUAL_CLOCK
+#define HAVE_VIRTUAL_CLOCK 1
+#else
+#define HAVE_VIRTUAL_CLOCK 0
+#endif
 /**@}*/
 
 #include <stdlib.h>
@@ -0,0 +1,116 @@
+// Copyright (c) 2015-2019 The HomeKit ADK Contributors
+//
+// Licensed under the Apache License, Version 2.0 (the “License”);
+// you may not use this file except in compliance with the License.
+// See [CONTRIBUTORS.md] for the list of HomeKit ADK project authors.
+//
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HAP_PLATFORM_CLOCK_INIT_H
+#define HAP_PLATFORM_CLOCK_INIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+#include "HAPPlatform+Init.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Clock implementation for POSIX.
+ *
+ * In addition to HAPPlatformClockGetCurrent, a cached time that is refreshed once per run loop iteration and a
+ * high-resolution clock for instrumentation are provided.
+ *
+ * If HAVE_VIRTUAL_CLOCK is set, HAPPlatformClockGetCurrent returns a virtual time that starts at 0 and only advances
+ * when it is explicitly set. The run loop advances the virtual time to the next timer deadline whenever no I/O is
+ * ready, so that long sequences of timers can be replayed deterministically and without waiting.
+ * This mode is intended for host-side simulation only.
+ */
+
+/**
+ * Returns the time of the current run loop iteration.
+ *
+ * - The value is refreshed once per run loop iteration, after waiting for events, and is intended for timeout
+ *   arithmetic in callbacks where an exact time is not needed. It is cheaper than HAPPlatformClockGetCurrent.
+ *
+ * - This function must be called on the run loop.
+ *
+ * @return Cached time in milliseconds.
+ */
+HAP_RESULT_USE_CHECK
+HAPTime HAPPlatformClockGetLoopTime(void);
+
+/**
+ * Refreshes the time of the current run loop iteration.
+ *
+ * - This function is called by the run loop.
+ *
+ * @return Current time in milliseconds.
+ */
+HAPTime HAPPlatformClockUpdateLoopTime(void);
+
+/**
+ * Returns the time of a monotonic high-resolution clock, for instrumentation.
+ *
+ * - The clock is unrelated to HAPPlatformClockGetCurrent and is not affected by the virtual clock.
+ *
+ * @return Time in microseconds since boot.
+ */
+HAP_RESULT_USE_CHECK
+uint64_t HAPPlatformClockGetCurrentMicroseconds(void);
+
+/**
+ * Returns the time of a monotonic high-resolution clock, for instrumentation.
+ *
+ * - The clock is unrelated to HAPPlatformClockGetCurrent and is not affected by the virtual clock.
+ * - The actual resolution depends on the platform and may be coarser than 1 ns.
+ *
+ * @return Time in nanoseconds.
+ */
+HAP_RESULT_USE_CHECK
+uint64_t HAPPlatformClockGetCurrentNanoseconds(void);
+
+#if HAVE_VIRTUAL_CLOCK
+/**
+ * Sets the virtual time.
+ *
+ * - The virtual time must not go backwards.
+ *
+ * @param      now                  New virtual time.
+ */
+void HAPPlatformClockSetVirtualTime(HAPTime now);
+
+/**
+ * Advances the virtual time.
+ *
+ * @param      delta                Time in milliseconds by which to advance the virtual time.
+ */
+void HAPPlatformClockAdvanceVirtualTime(HAPTime delta);
+#endif
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
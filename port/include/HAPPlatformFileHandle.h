@@ -73,7 +73,8 @@ typedef void (*HAPPlatformFileHandleCallback)(
 /**
  * Registers a platform-specific file descriptor for which a callback shall be invoked when one or more events occur.
  *
- * - The platform-specific file descriptor must not already be registered.
+ * - A platform-specific file descriptor can only be registered once. Registering a file descriptor that is already
+ *   registered fails with kHAPError_InvalidState.
  *
  * - The callback is never invoked synchronously.
  *
@@ -84,6 +85,7 @@ typedef void (*HAPPlatformFileHandleCallback)(
  * @param      context              Context that shall be passed to the callback.
  *
  * @return kHAPError_None           If successful.
+ * @return kHAPError_InvalidState   If the platform-specific file descriptor is already registered.
  * @return kHAPError_OutOfResources If no more resources for registrations can be allocated.
  */
 HAP_RESULT_USE_CHECK
@@ -26,19 +26,57 @@ extern "C" {
 #endif
 
 #include "HAPPlatform.h"
+#include "HAPPlatform+Init.h"
 
 #if __has_feature(nullability)
 #pragma clang assume_nonnull begin
 #endif
 
 /**@file
- * Global run loop for POSIX.
+ * Run loop for POSIX.
  *
  * This implementation implements the following platform modules:
  * - HAPPlatformRunLoop
  * - HAPPlatformTimer
  * - HAPPlatformFileHandle (POSIX-specific)
+ *
+ * Timer references carry a generation count. HAPPlatformTimerDeregister is O(1), and deregistering a timer that has
+ * already expired, or that is currently invoking its callback, is a no-op.
+ *
+ * By default, a single global run loop is used. Additional run loop instances may be created with
+ * HAPPlatformRunLoopCreateInstance, e.g., to host multiple accessory servers in one process. The run loop functions
+ * operate on the instance that is bound to the calling thread with HAPPlatformRunLoopSetCurrent, or on the global run
+ * loop if no instance is bound. Each instance has its own timers, file handles, scheduled callback queues and
+ * loopback port. Threads that do not run an instance can schedule callbacks onto it with the *OnInstance variants of
+ * the scheduling functions, without binding it.
+ */
+
+/**
+ * Run loop instance.
+ */
+typedef struct HAPPlatformRunLoop HAPPlatformRunLoop;
+typedef struct HAPPlatformRunLoop* HAPPlatformRunLoopRef;
+HAP_NONNULL_SUPPORT(HAPPlatformRunLoop)
+
+/**
+ * Default number of preallocated file handles.
+ */
+#define kHAPPlatformRunLoop_DefaultNumFileHandles ((size_t) 16)
+
+/**
+ * Default number of preallocated timers.
  */
+#define kHAPPlatformRunLoop_DefaultNumTimers ((size_t) 32)
+
+/**
+ * Default minimum time in milliseconds until the next timer deadline for idle tasks to run.
+ */
+#define kHAPPlatformRunLoop_DefaultIdleTaskMargin ((HAPTime) 10)
+
+/**
+ * Default time budget in milliseconds for idle tasks per run loop iteration.
+ */
+#define kHAPPlatformRunLoop_DefaultIdleTaskBudget ((HAPTime) 5)
 
 /**
  * Run loop initialization options.
@@ -48,8 +86,357 @@ typedef struct {
      * Key-value store.
      */
     HAPPlatformKeyValueStoreRef keyValueStore;
+
+    /**
+     * Number of file handles that are preallocated when the run loop is created.
+     *
+     * - If 0, kHAPPlatformRunLoop_DefaultNumFileHandles file handles are preallocated.
+     */
+    size_t numFileHandles;
+
+    /**
+     * Number of timers that are preallocated when the run loop is created.
+     *
+     * - If 0, kHAPPlatformRunLoop_DefaultNumTimers timers are preallocated.
+     *
+     * - The number of timers is limited by the width of timer references: 16383 on 32-bit targets.
+     */
+    size_t numTimers;
+
+    /**
+     * Whether registrations fail once all preallocated file handles or timers are in use.
+     *
+     * - By default, additional file handles and timers are allocated from the heap in slabs of the preallocated size.
+     *   Slabs are only released together with the run loop.
+     */
+    bool disallowsHeapOverflow;
+
+    /**
+     * Whether the order in which ready file handles are dispatched is rotated every run loop iteration.
+     *
+     * - By default, ready file handles are dispatched in ascending order of their file descriptors, so file handles
+     *   that were registered early, e.g., the TCP stream listener, are always served first.
+     */
+    bool rotatesFileHandleDispatch;
+
+    /**
+     * Time budget in milliseconds for dispatching file handle callbacks per run loop iteration.
+     *
+     * - The budget applies to a run loop iteration as a whole, not to individual callbacks. It is checked between
+     *   callbacks, so a callback that exceeds the budget on its own is not interrupted.
+     *
+     * - Once the budget is exhausted, ready file handles that have not yet been dispatched stay pending. They are
+     *   dispatched first in the next iteration, after expired timers have been processed.
+     *
+     * - Scheduled callbacks are dispatched by a file handle and share the budget. Once it is exhausted, remaining
+     *   scheduled callbacks stay queued for the next iteration. At least one scheduled callback is invoked per
+     *   iteration, so that they make progress under load.
+     *
+     * - If 0, all ready file handles and all scheduled callbacks published before the iteration are dispatched in
+     *   every iteration.
+     */
+    HAPTime fileHandleDispatchBudget;
+
+    /**
+     * Minimum time in milliseconds until the next timer deadline for idle tasks to run.
+     *
+     * - If 0, kHAPPlatformRunLoop_DefaultIdleTaskMargin is used.
+     */
+    HAPTime idleTaskMargin;
+
+    /**
+     * Time budget in milliseconds for idle tasks per run loop iteration.
+     *
+     * - Idle tasks are invoked round-robin until the budget is exhausted. A single idle task invocation is not
+     *   interrupted, so each invocation should only perform a small slice of work.
+     *
+     * - If 0, kHAPPlatformRunLoop_DefaultIdleTaskBudget is used.
+     */
+    HAPTime idleTaskBudget;
 } HAPPlatformRunLoopOptions;
 
+/**
+ * Statistics of a run loop object pool.
+ */
+typedef struct {
+    /**
+     * Number of objects in use.
+     */
+    size_t numElements;
+
+    /**
+     * Highest number of objects that have been in use at the same time.
+     */
+    size_t maxElements;
+
+    /**
+     * Number of objects in the allocated slabs, including retired objects.
+     */
+    size_t capacity;
+
+    /**
+     * Number of allocated slabs.
+     */
+    size_t numSlabs;
+
+    /**
+     * Number of allocations that failed because no object was available.
+     */
+    size_t numFailedAllocations;
+
+    /**
+     * Number of objects that are no longer reused because their generation count is exhausted.
+     */
+    size_t numRetiredElements;
+} HAPPlatformRunLoopObjectPoolStatistics;
+
+/**
+ * Statistics of the run loop object pools.
+ */
+typedef struct {
+    /**
+     * File handle pool.
+     */
+    HAPPlatformRunLoopObjectPoolStatistics fileHandles;
+
+    /**
+     * Timer pool.
+     */
+    HAPPlatformRunLoopObjectPoolStatistics timers;
+} HAPPlatformRunLoopPoolStatistics;
+
+/**
+ * Type of a callback that is invoked by the run loop.
+ */
+HAP_ENUM_BEGIN(uint8_t, HAPPlatformRunLoopCallbackType) { /**
+                                                           * File handle callback.
+                                                           */
+                                                          kHAPPlatformRunLoopCallbackType_FileHandle = 1,
+
+                                                          /**
+                                                           * Timer callback.
+                                                           */
+                                                          kHAPPlatformRunLoopCallbackType_Timer,
+
+                                                          /**
+                                                           * Callback scheduled with
+                                                           * HAPPlatformRunLoopScheduleCallback.
+                                                           */
+                                                          kHAPPlatformRunLoopCallbackType_Scheduled,
+
+                                                          /**
+                                                           * Idle task.
+                                                           */
+                                                          kHAPPlatformRunLoopCallbackType_Idle
+} HAP_ENUM_END(uint8_t, HAPPlatformRunLoopCallbackType);
+
+#if HAVE_RUN_LOOP_STATISTICS
+/**
+ * Number of buckets of a run loop histogram.
+ */
+#define kHAPPlatformRunLoopHistogram_NumBuckets ((size_t) 24)
+
+/**
+ * Maximum number of distinct callbacks for which run loop statistics are tracked.
+ */
+#define kHAPPlatformRunLoopStatistics_MaxCallbacks ((size_t) 16)
+
+/**
+ * Histogram with logarithmic buckets.
+ *
+ * - Bucket 0 counts values of 0. Bucket i counts values in the range [2^(i-1), 2^i).
+ *   The last bucket also counts all larger values.
+ */
+typedef struct {
+    /**
+     * Number of values per bucket.
+     */
+    uint32_t buckets[kHAPPlatformRunLoopHistogram_NumBuckets];
+
+    /**
+     * Number of recorded values.
+     */
+    uint32_t numValues;
+
+    /**
+     * Sum of recorded values.
+     */
+    uint64_t sum;
+
+    /**
+     * Largest recorded value.
+     */
+    uint64_t max;
+} HAPPlatformRunLoopHistogram;
+
+/**
+ * Run loop statistics of a callback.
+ */
+typedef struct {
+    /**
+     * Address of the callback function.
+     */
+    const void* _Nullable callback;
+
+    /**
+     * Callback type.
+     */
+    HAPPlatformRunLoopCallbackType type;
+
+    /**
+     * Number of invocations.
+     */
+    uint32_t numInvocations;
+
+    /**
+     * Total time spent in the callback, in microseconds.
+     */
+    uint64_t totalDuration;
+
+    /**
+     * Longest invocation of the callback, in microseconds.
+     */
+    uint64_t maxDuration;
+} HAPPlatformRunLoopCallbackStatistics;
+
+/**
+ * Run loop statistics.
+ */
+typedef struct {
+    /**
+     * Number of run loop iterations.
+     */
+    uint32_t numIterations;
+
+    /**
+     * Time blocked in the I/O multiplexer per iteration, in microseconds.
+     */
+    HAPPlatformRunLoopHistogram blockedDuration;
+
+    /**
+     * Duration of file handle callbacks, in microseconds.
+     *
+     * - The internal loopback file handle is not included. Scheduled callbacks that it dispatches are recorded in
+     *   scheduledCallbackDuration.
+     */
+    HAPPlatformRunLoopHistogram fileHandleCallbackDuration;
+
+    /**
+     * Duration of timer callbacks, in microseconds.
+     */
+    HAPPlatformRunLoopHistogram timerCallbackDuration;
+
+    /**
+     * Duration of scheduled callbacks, in microseconds.
+     */
+    HAPPlatformRunLoopHistogram scheduledCallbackDuration;
+
+    /**
+     * Duration of idle task invocations, in microseconds.
+     */
+    HAPPlatformRunLoopHistogram idleTaskDuration;
+
+    /**
+     * Time between the deadline of a timer and the invocation of its callback, in milliseconds.
+     *
+     * - Unlike the duration histograms, lateness is recorded in milliseconds, the resolution of timer deadlines.
+     */
+    HAPPlatformRunLoopHistogram timerLateness;
+
+    /**
+     * Number of timer wakeups that were saved by firing timers early within their tolerance.
+     *
+     * - Only timers that fired in a wakeup caused by another timer or by events are counted.
+     */
+    uint32_t numSavedTimerWakeups;
+
+    /**
+     * Number of run loop iterations in which file handle dispatch stopped because the budget was exhausted.
+     */
+    uint32_t numDeferredFileHandleDispatches;
+
+    /**
+     * Number of run loop iterations in which scheduled callbacks were left queued because the file handle dispatch
+     * budget was exhausted.
+     */
+    uint32_t numDeferredScheduledCallbackDispatches;
+
+    /**
+     * Number of callbacks in the scheduled callback queues when the run loop starts draining them.
+     */
+    HAPPlatformRunLoopHistogram scheduledCallbackQueueDepth;
+
+    /**
+     * Number of scheduled callbacks that were skipped because a newer callback with the same coalescing key was queued.
+     */
+    uint32_t numCoalescedCallbacks;
+
+    /**
+     * Statistics per callback, in order of first invocation.
+     */
+    HAPPlatformRunLoopCallbackStatistics callbacks[kHAPPlatformRunLoopStatistics_MaxCallbacks];
+
+    /**
+     * Number of valid entries in callbacks.
+     */
+    size_t numCallbacks;
+
+    /**
+     * Number of invocations of callbacks that are not tracked in callbacks because it is full.
+     */
+    uint32_t numUntrackedCallbackInvocations;
+} HAPPlatformRunLoopStatistics;
+#endif
+
+#if HAVE_RUN_LOOP_WATCHDOG
+/**
+ * Callback dispatch that exceeded the run loop watchdog threshold.
+ */
+typedef struct {
+    /**
+     * Callback type.
+     */
+    HAPPlatformRunLoopCallbackType type;
+
+    /**
+     * Address of the callback function.
+     */
+    const void* _Nullable callback;
+
+    /**
+     * Time at which the callback was invoked, in microseconds since boot.
+     */
+    uint64_t startTime;
+
+    /**
+     * Duration of the callback, in microseconds.
+     *
+     * - While the callback is still executing, this is the duration at the last watchdog check.
+     */
+    uint64_t duration;
+} HAPPlatformRunLoopStall;
+
+/**
+ * Run loop watchdog statistics.
+ */
+typedef struct {
+    /**
+     * Number of callback dispatches that exceeded the watchdog threshold.
+     */
+    uint32_t numStalls;
+
+    /**
+     * Most recent stall.
+     */
+    HAPPlatformRunLoopStall lastStall;
+
+    /**
+     * Longest stall.
+     */
+    HAPPlatformRunLoopStall longestStall;
+} HAPPlatformRunLoopWatchdogStatistics;
+#endif
+
 /**
  * Create run loop.
  */
@@ -60,6 +447,479 @@ void HAPPlatformRunLoopCreate(const HAPPlatformRunLoopOptions* options);
  */
 void HAPPlatformRunLoopRelease(void);
 
+/**
+ * Creates an additional run loop instance.
+ *
+ * - The instance is not bound to any thread. Call HAPPlatformRunLoopSetCurrent on the thread that runs it, before
+ *   creating the other platform objects and the accessory server that use it.
+ *
+ * @param[out] runLoop              Run loop instance.
+ * @param      options              Initialization options.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the instance could not be allocated.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopCreateInstance(HAPPlatformRunLoopRef* runLoop, const HAPPlatformRunLoopOptions* options);
+
+/**
+ * Releases a run loop instance that has been created with HAPPlatformRunLoopCreateInstance.
+ *
+ * - The run loop must not be running. If the instance is bound to the calling thread, the thread falls back to the
+ *   global run loop.
+ *
+ * - All timers and file handles that have been registered on the instance must have been deregistered.
+ *
+ * @param      runLoop              Run loop instance.
+ */
+void HAPPlatformRunLoopReleaseInstance(HAPPlatformRunLoopRef runLoop);
+
+/**
+ * Binds a run loop instance to the calling thread.
+ *
+ * - All run loop, timer and file handle functions that are called on this thread operate on the bound instance.
+ *
+ * - Threads that only schedule callbacks onto an instance, e.g., sensor tasks of a particular accessory, should use the
+ *   *OnInstance variants of the scheduling functions instead of binding the instance.
+ *
+ * @param      runLoop              Run loop instance. NULL to use the global run loop.
+ */
+void HAPPlatformRunLoopSetCurrent(HAPPlatformRunLoopRef _Nullable runLoop);
+
+/**
+ * Returns the run loop instance that is bound to the calling thread.
+ *
+ * @return Bound run loop instance, or the global run loop if no instance is bound.
+ */
+HAP_RESULT_USE_CHECK
+HAPPlatformRunLoopRef HAPPlatformRunLoopGetCurrent(void);
+
+/**
+ * Registers a timer that may fire at any time within a window after its deadline.
+ *
+ * - The run loop wakes up at the latest within the window of the first timer, and fires all timers whose window has
+ *   been entered by then in the same pass. Timers that do not require precise timing, such as idle timeouts, should
+ *   specify a tolerance to reduce the number of wakeups.
+ *
+ * - A tolerance of 0 behaves like HAPPlatformTimerRegister.
+ *
+ * @param[out] timer                Non-zero Timer object reference, if successful.
+ * @param      deadline             Earliest time at which the timer expires.
+ * @param      tolerance            Maximum time in milliseconds by which the timer may be fired after its deadline.
+ * @param      callback             Function to call when the timer expires.
+ * @param      context              Context that is passed to the callback.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If no more timers can be allocated.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTimerRegisterWithTolerance(
+        HAPPlatformTimerRef* timer,
+        HAPTime deadline,
+        HAPTime tolerance,
+        HAPPlatformTimerCallback callback,
+        void* _Nullable context);
+
+/**
+ * Registers a periodic timer.
+ *
+ * - The timer first expires at the given deadline and is then re-armed at a fixed rate, i.e., each deadline is the
+ *   previous deadline plus the period, regardless of when the callback was actually invoked. Expirations that have been
+ *   missed entirely, e.g., because the run loop was blocked for longer than a period, are skipped.
+ *
+ * - The same timer reference is passed to every invocation of the callback. The timer stays registered until it is
+ *   deregistered with HAPPlatformTimerDeregister, which may also be called from within the callback.
+ *
+ * @param[out] timer                Non-zero Timer object reference, if successful.
+ * @param      deadline             Deadline of the first expiration.
+ * @param      period               Period in milliseconds. Must be non-zero.
+ * @param      callback             Function to call whenever the timer expires.
+ * @param      context              Context that is passed to the callback.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If no more timers can be allocated.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTimerRegisterPeriodic(
+        HAPPlatformTimerRef* timer,
+        HAPTime deadline,
+        HAPTime period,
+        HAPPlatformTimerCallback callback,
+        void* _Nullable context);
+
+/**
+ * Changes the period of a timer.
+ *
+ * - The currently scheduled deadline is kept. The new period applies when the timer is re-armed after its next
+ *   expiration.
+ *
+ * - A period of 0 turns the timer into a one-shot timer that is released after its next expiration.
+ *   A non-zero period turns a one-shot timer into a periodic timer.
+ *
+ * - Changing the period of a timer that has already expired is a no-op.
+ *
+ * @param      timer                Timer.
+ * @param      period               Period in milliseconds.
+ */
+void HAPPlatformTimerSetPeriod(HAPPlatformTimerRef timer, HAPTime period);
+
+/**
+ * Scheduled callback priority.
+ */
+HAP_ENUM_BEGIN(uint8_t, HAPPlatformRunLoopCallbackPriority) { /**
+                                                               * Callbacks are invoked in the order they were scheduled.
+                                                               */
+                                                              kHAPPlatformRunLoopCallbackPriority_Normal,
+
+                                                              /**
+                                                               * Callbacks are invoked before any pending callback of
+                                                               * normal priority.
+                                                               */
+                                                              kHAPPlatformRunLoopCallbackPriority_Urgent
+} HAP_ENUM_END(uint8_t, HAPPlatformRunLoopCallbackPriority);
+
+/**
+ * Options for HAPPlatformRunLoopScheduleCallbackWithOptions.
+ */
+typedef struct {
+    /**
+     * Priority of the callback.
+     */
+    HAPPlatformRunLoopCallbackPriority priority;
+
+    /**
+     * Coalescing key. 0 if the callback must not be coalesced.
+     *
+     * - If multiple callbacks with the same non-zero key are queued with the same priority, only the most recently
+     *   scheduled one is invoked. The older ones are dropped without being called.
+     *
+     * - Use this for state updates where only the latest value matters, e.g., sensor readings.
+     */
+    uint32_t coalescingKey;
+} HAPPlatformRunLoopScheduleOptions;
+
+/**
+ * Schedules a callback that will be called from the run loop, with a priority and an optional coalescing key.
+ *
+ * - The context is copied, like with HAPPlatformRunLoopScheduleCallback.
+ *
+ * - Urgent callbacks have a separate, smaller queue and are invoked before pending normal priority callbacks.
+ *
+ * - This function may be called from any thread. The callback is scheduled onto the run loop that is bound to the
+ *   calling thread.
+ *
+ * @param      callback             Function to call on the run loop.
+ * @param      context              Context that is passed to the callback.
+ * @param      contextSize          Size of context data that is passed to the callback.
+ * @param      options              Options.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the run loop has not been created, or if it could not be woken up. In the latter
+ *                                  case the callback has been queued and is invoked after the next successful wakeup.
+ * @return kHAPError_OutOfResources If the queue of the requested priority is full or the context is too large.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbackWithOptions(
+        HAPPlatformRunLoopCallback callback,
+        void* _Nullable context,
+        size_t contextSize,
+        const HAPPlatformRunLoopScheduleOptions* options);
+
+/**
+ * Schedules a callback that will be called from a specific run loop, with a priority and an optional coalescing key.
+ *
+ * - Same as HAPPlatformRunLoopScheduleCallbackWithOptions, but independent of the run loop that is bound to the
+ *   calling thread.
+ *
+ * - This function may be called from any thread.
+ *
+ * @param      runLoop              Run loop instance, or HAPPlatformRunLoopGetCurrent() of the thread running it.
+ * @param      callback             Function to call on the run loop.
+ * @param      context              Context that is passed to the callback.
+ * @param      contextSize          Size of context data that is passed to the callback.
+ * @param      options              Options.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the run loop has not been created, or if it could not be woken up. In the latter
+ *                                  case the callback has been queued and is invoked after the next successful wakeup.
+ * @return kHAPError_OutOfResources If the queue of the requested priority is full or the context is too large.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbackWithOptionsOnInstance(
+        HAPPlatformRunLoopRef runLoop,
+        HAPPlatformRunLoopCallback callback,
+        void* _Nullable context,
+        size_t contextSize,
+        const HAPPlatformRunLoopScheduleOptions* options);
+
+/**
+ * Schedules a callback that will be called from a specific run loop.
+ *
+ * - Same as HAPPlatformRunLoopScheduleCallback, but independent of the run loop that is bound to the calling thread.
+ *
+ * - This function may be called from any thread.
+ *
+ * @param      runLoop              Run loop instance, or HAPPlatformRunLoopGetCurrent() of the thread running it.
+ * @param      callback             Function to call on the run loop.
+ * @param      context              Context that is passed to the callback. The context is copied.
+ * @param      contextSize          Size of context data that is passed to the callback. Must not exceed UINT8_MAX.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the run loop has not been created, or if it could not be woken up. In the latter
+ *                                  case the callback has been queued and is invoked after the next successful wakeup.
+ * @return kHAPError_OutOfResources If the scheduled callback queue is full or the context is too large.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbackOnInstance(
+        HAPPlatformRunLoopRef runLoop,
+        HAPPlatformRunLoopCallback callback,
+        void* _Nullable context,
+        size_t contextSize);
+
+typedef struct HAPPlatformRunLoopIdleTask HAPPlatformRunLoopIdleTask;
+
+/**
+ * Callback that performs a slice of deferred background work while the run loop is idle.
+ *
+ * @param      idleTask             Idle task.
+ * @param      context              The context parameter given to the HAPPlatformRunLoopRegisterIdleTask function.
+ *
+ * @return true                     If the idle task has more work pending.
+ * @return false                    If the idle task has no more work until HAPPlatformRunLoopSignalIdleTask is called.
+ */
+typedef bool (*HAPPlatformRunLoopIdleTaskCallback)(HAPPlatformRunLoopIdleTask* idleTask, void* _Nullable context);
+
+/**
+ * Idle task, e.g., to flush a log buffer, to compact key-value store writes or to precompute crypto material.
+ */
+struct HAPPlatformRunLoopIdleTask {
+    // Opaque type. Do not access the instance fields directly.
+    /**@cond */
+    HAPPlatformRunLoopIdleTaskCallback _Nullable callback;
+    void* _Nullable context;
+    HAPPlatformRunLoopIdleTask* _Nullable prevIdleTask;
+    HAPPlatformRunLoopIdleTask* _Nullable nextIdleTask;
+    bool hasWork;
+    /**@endcond */
+};
+
+/**
+ * Registers an idle task.
+ *
+ * - Idle tasks only run when the run loop would otherwise block, i.e., when no file handle is ready and no timer is
+ *   due within the idle task margin. They are invoked round-robin within the idle task budget.
+ *
+ * - The idle task is registered with pending work, so it is invoked once the run loop becomes idle.
+ *
+ * - This function must be called on the run loop.
+ *
+ * @param      idleTask             Idle task. Must be zero-initialized or deregistered, and must stay valid until it is
+ *                                  deregistered.
+ * @param      callback             Function to call while the run loop is idle.
+ * @param      context              Context that is passed to the callback.
+ */
+void HAPPlatformRunLoopRegisterIdleTask(
+        HAPPlatformRunLoopIdleTask* idleTask,
+        HAPPlatformRunLoopIdleTaskCallback callback,
+        void* _Nullable context);
+
+/**
+ * Deregisters an idle task.
+ *
+ * - This function may be called from within the idle task callback.
+ *
+ * - This function must be called on the run loop.
+ *
+ * @param      idleTask             Idle task.
+ */
+void HAPPlatformRunLoopDeregisterIdleTask(HAPPlatformRunLoopIdleTask* idleTask);
+
+/**
+ * Informs the run loop that an idle task has new work pending.
+ *
+ * - When called from within the idle task callback, the return value of the callback takes precedence.
+ *
+ * - This function must be called on the run loop.
+ *
+ * @param      idleTask             Idle task.
+ */
+void HAPPlatformRunLoopSignalIdleTask(HAPPlatformRunLoopIdleTask* idleTask);
+
+/**
+ * Callback to schedule with HAPPlatformRunLoopScheduleCallbacks.
+ */
+typedef struct {
+    /**
+     * Function to call on the run loop.
+     */
+    HAPPlatformRunLoopCallback callback;
+
+    /**
+     * Context that is passed to the callback. The context is copied.
+     */
+    void* _Nullable context;
+
+    /**
+     * Size of context data that is passed to the callback. Must not exceed UINT8_MAX.
+     */
+    size_t contextSize;
+} HAPPlatformRunLoopScheduledCallbackRecord;
+
+/**
+ * Schedules multiple callbacks that will be called from the run loop.
+ *
+ * - Either all callbacks are scheduled or none. The run loop is woken once and invokes the callbacks in order within
+ *   a single iteration.
+ *
+ * - Callbacks are scheduled with normal priority and are not coalesced.
+ *
+ * - This function may be called from any thread. The callbacks are scheduled onto the run loop that is bound to the
+ *   calling thread.
+ *
+ * @param      records              Callbacks to schedule.
+ * @param      numRecords           Number of callbacks.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the run loop has not been created, or if it could not be woken up. In the latter
+ *                                  case the callbacks have been queued and are invoked after the next successful
+ *                                  wakeup.
+ * @return kHAPError_OutOfResources If the scheduled callback queue does not have room for all callbacks or a context
+ *                                  is too large.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbacks(
+        const HAPPlatformRunLoopScheduledCallbackRecord* records,
+        size_t numRecords);
+
+/**
+ * Schedules multiple callbacks that will be called from a specific run loop.
+ *
+ * - Same as HAPPlatformRunLoopScheduleCallbacks, but independent of the run loop that is bound to the calling thread.
+ *
+ * - This function may be called from any thread.
+ *
+ * @param      runLoop              Run loop instance, or HAPPlatformRunLoopGetCurrent() of the thread running it.
+ * @param      records              Callbacks to schedule.
+ * @param      numRecords           Number of callbacks.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the run loop has not been created, or if it could not be woken up. In the latter
+ *                                  case the callbacks have been queued and are invoked after the next successful
+ *                                  wakeup.
+ * @return kHAPError_OutOfResources If the scheduled callback queue does not have room for all callbacks or a context
+ *                                  is too large.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbacksOnInstance(
+        HAPPlatformRunLoopRef runLoop,
+        const HAPPlatformRunLoopScheduledCallbackRecord* records,
+        size_t numRecords);
+
+/**
+ * Schedules a callback that will be called from the run loop, passing the context by reference.
+ *
+ * - Unlike HAPPlatformRunLoopScheduleCallback, the context is not copied, so its size is not limited to UINT8_MAX.
+ *
+ * - The run loop must have been created.
+ *
+ * - Unless kHAPError_OutOfResources is returned, ownership of the context is transferred to the callback, which must
+ *   release it. Otherwise, ownership remains with the caller.
+ *
+ * - This function may be called from any thread. The callback is scheduled onto the run loop that is bound to the
+ *   calling thread.
+ *
+ * @param      callback             Function to call on the run loop.
+ * @param      context              Context that is passed to the callback.
+ * @param      contextSize          Context size that is passed to the callback.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the run loop could not be woken up. The callback has been queued and is invoked
+ *                                  after the next successful wakeup.
+ * @return kHAPError_OutOfResources If the scheduled callback queue is full.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbackByReference(
+        HAPPlatformRunLoopCallback callback,
+        void* context,
+        size_t contextSize);
+
+/**
+ * Schedules a callback that will be called from a specific run loop, passing the context by reference.
+ *
+ * - Same as HAPPlatformRunLoopScheduleCallbackByReference, but independent of the run loop that is bound to the
+ *   calling thread.
+ *
+ * - This function may be called from any thread.
+ *
+ * @param      runLoop              Run loop instance, or HAPPlatformRunLoopGetCurrent() of the thread running it.
+ * @param      callback             Function to call on the run loop.
+ * @param      context              Context that is passed to the callback.
+ * @param      contextSize          Context size that is passed to the callback.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the run loop could not be woken up. The callback has been queued and is invoked
+ *                                  after the next successful wakeup.
+ * @return kHAPError_OutOfResources If the scheduled callback queue is full.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbackByReferenceOnInstance(
+        HAPPlatformRunLoopRef runLoop,
+        HAPPlatformRunLoopCallback callback,
+        void* context,
+        size_t contextSize);
+
+/**
+ * Fetches the statistics of the run loop object pools.
+ *
+ * @param[out] statistics           Statistics.
+ */
+void HAPPlatformRunLoopGetPoolStatistics(HAPPlatformRunLoopPoolStatistics* statistics);
+
+#if HAVE_RUN_LOOP_STATISTICS
+/**
+ * Fetches the run loop statistics that have been collected since the run loop was created or since the last reset.
+ *
+ * - This function must be called on the run loop.
+ *
+ * @param[out] statistics           Statistics.
+ */
+void HAPPlatformRunLoopGetStatistics(HAPPlatformRunLoopStatistics* statistics);
+
+/**
+ * Resets the run loop statistics.
+ *
+ * - This function must be called on the run loop.
+ */
+void HAPPlatformRunLoopResetStatistics(void);
+#endif
+
+#if HAVE_RUN_LOOP_WATCHDOG
+/**
+ * Fetches the statistics of the run loop watchdog.
+ *
+ * - The watchdog runs as a separate task and checks periodically whether the callback that the run loop is currently
+ *   dispatching has exceeded CONFIG_HAP_RUN_LOOP_WATCHDOG_THRESHOLD_MS. Each such stall is logged once.
+ *
+ * - This function operates on the run loop that is bound to the calling thread. Other threads must use
+ *   HAPPlatformRunLoopGetWatchdogStatisticsOfInstance.
+ *
+ * @param[out] statistics           Statistics.
+ */
+void HAPPlatformRunLoopGetWatchdogStatistics(HAPPlatformRunLoopWatchdogStatistics* statistics);
+
+/**
+ * Fetches the statistics of the watchdog of a specific run loop.
+ *
+ * - This function may be called from any thread while the run loop exists.
+ *
+ * @param      runLoop              Run loop instance, or HAPPlatformRunLoopGetCurrent() of the thread running it.
+ * @param[out] statistics           Statistics.
+ */
+void HAPPlatformRunLoopGetWatchdogStatisticsOfInstance(
+        HAPPlatformRunLoopRef runLoop,
+        HAPPlatformRunLoopWatchdogStatistics* statistics);
+#endif
+
 #if __has_feature(nullability)
 #pragma clang assume_nonnull end
 #endif
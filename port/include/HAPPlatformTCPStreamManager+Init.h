@@ -54,12 +54,43 @@ extern "C" {
          .port = kHAPNetworkPort_Any,
 
            // Allocate enough concurrent TCP streams to support the IP accessory.
-           .maxConcurrentTCPStreams = kHAPIPSessionStorage_DefaultNumElements
+           .maxConcurrentTCPStreams = kHAPIPSessionStorage_DefaultNumElements,
+
+           // Accept all pending connections in a single run loop iteration.
+           .batchAccept = true
    });
 
    @endcode
  */
 
+/**
+ * Callback that is invoked when a connection is pending while the maximum number of concurrent TCP streams is
+ * reached, to ask for an idle TCP stream to be closed so that the connection can be admitted.
+ *
+ * - The TCP stream manager never closes TCP streams on its own. To evict the TCP stream, the callback closes the
+ *   session that uses it, e.g., if the session is not secured or has no request in progress, which in turn closes
+ *   the TCP stream using HAPPlatformTCPStreamClose before the callback returns.
+ *
+ * - To keep the TCP stream open, the callback returns without closing it. The next least recently active
+ *   TCP stream is then offered.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param      tcpStream            Least recently active TCP stream that has not yet been offered.
+ * @param      idleTime             Time since data has last been read from or written to the TCP stream.
+ * @param      context              The context parameter given to the HAPPlatformTCPStreamManagerCreate function.
+ */
+typedef void (*HAPPlatformTCPStreamManagerEvictionCallback)(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamRef tcpStream,
+        HAPTime idleTime,
+        void* _Nullable context);
+
+/**
+ * Time in milliseconds after which eviction is retried if no TCP stream could be evicted to admit a pending
+ * connection.
+ */
+#define kHAPPlatformTCPStreamManager_EvictionRetryInterval ((HAPTime) 1000)
+
 /**
  * TCP stream manager initialization options.
  */
@@ -75,8 +106,257 @@ typedef struct {
      * Maximum number of concurrent TCP streams.
      */
     size_t maxConcurrentTCPStreams;
+
+    /**
+     * Whether to drain the accept backlog in a single listener event.
+     *
+     * - If true, the listener callback is invoked repeatedly for each readiness event of the listener socket until
+     *   no more connections are pending or the maximum number of concurrent TCP streams is reached.
+     *   This avoids one run loop iteration per connection when many controllers reconnect at the same time.
+     *
+     * - If false, the listener callback is invoked once per readiness event.
+     */
+    bool batchAccept;
+
+    /**
+     * Maximum length of the queue of pending connections of the TCP stream listener.
+     *
+     * - A value of 0 will use kHAPPlatformTCPStreamManager_DefaultBacklog.
+     */
+    size_t backlog;
+
+    /**
+     * Receive buffer size of TCP streams in bytes (SO_RCVBUF).
+     *
+     * - A value of 0 will use the system default.
+     *
+     * - The size is also applied to the TCP stream listener so that it can be taken into account for the window
+     *   advertised during connection establishment.
+     */
+    size_t receiveBufferSize;
+
+    /**
+     * Send buffer size of TCP streams in bytes (SO_SNDBUF).
+     *
+     * - A value of 0 will use the system default.
+     */
+    size_t sendBufferSize;
+
+    /**
+     * TCP keepalive configuration of TCP streams.
+     *
+     * - Keepalive probes allow detecting controllers that disappeared without closing their connection,
+     *   e.g., after losing Wi-Fi connectivity, so that their TCP streams do not hold a slot indefinitely.
+     */
+    struct {
+        /**
+         * Whether keepalive probes are sent (SO_KEEPALIVE).
+         */
+        bool isEnabled;
+
+        /**
+         * Idle time before the first keepalive probe is sent (TCP_KEEPIDLE). Rounded up to full seconds.
+         *
+         * - A value of 0 will use the system default.
+         */
+        HAPTime idleTime;
+
+        /**
+         * Time between keepalive probes (TCP_KEEPINTVL). Rounded up to full seconds.
+         *
+         * - A value of 0 will use the system default.
+         */
+        HAPTime interval;
+
+        /**
+         * Number of unacknowledged keepalive probes before the connection is dropped (TCP_KEEPCNT).
+         *
+         * - A value of 0 will use the system default.
+         */
+        uint32_t count;
+    } keepAlive;
+
+    /**
+     * Maximum time that transmitted data may remain unacknowledged before the connection is dropped
+     * (TCP_USER_TIMEOUT).
+     *
+     * - A value of 0 will use the system default.
+     *
+     * - Ignored on platforms without support for the socket option TCP_USER_TIMEOUT.
+     */
+    HAPTime userTimeout;
+
+    /**
+     * Whether closing a TCP stream resets the connection instead of shutting it down gracefully (SO_LINGER with a
+     * timeout of 0). Data that has not been sent yet is discarded.
+     *
+     * - A nonzero linger timeout is not supported, as it would block the run loop in close until pending data has
+     *   been sent or the timeout expires.
+     */
+    bool resetsConnectionOnClose;
+
+    /**
+     * Eviction of idle TCP streams when the maximum number of concurrent TCP streams is reached.
+     *
+     * - If no callback is set, the TCP stream listener stops accepting connections until a TCP stream is closed.
+     *
+     * - If a callback is set, the TCP stream listener keeps accepting connections. When a connection is pending
+     *   while the maximum number of concurrent TCP streams is reached, idle TCP streams are offered to the callback
+     *   in least recently active order until one of them is closed. If none is closed, the TCP stream listener is
+     *   suspended for kHAPPlatformTCPStreamManager_EvictionRetryInterval.
+     */
+    struct {
+        /**
+         * Callback that is asked to close an idle TCP stream.
+         */
+        HAPPlatformTCPStreamManagerEvictionCallback _Nullable callback;
+
+        /**
+         * Client context pointer passed to the callback.
+         */
+        void* _Nullable context;
+
+        /**
+         * Minimum time since data has last been read from or written to a TCP stream before it is offered.
+         */
+        HAPTime minIdleTime;
+    } eviction;
 } HAPPlatformTCPStreamManagerOptions;
 
+/**
+ * Default maximum length of the queue of pending connections of the TCP stream listener.
+ */
+#define kHAPPlatformTCPStreamManager_DefaultBacklog ((size_t) 64)
+
+/**
+ * I/O counters of TCP streams.
+ */
+typedef struct {
+    /**
+     * Number of bytes read.
+     */
+    uint64_t numBytesRead;
+
+    /**
+     * Number of bytes written.
+     */
+    uint64_t numBytesWritten;
+
+    /**
+     * Number of read system calls.
+     */
+    uint32_t numReadCalls;
+
+    /**
+     * Number of write system calls.
+     */
+    uint32_t numWriteCalls;
+
+    /**
+     * Number of reads that returned kHAPError_Busy because no data was available.
+     */
+    uint32_t numBusyReads;
+
+    /**
+     * Number of writes that returned kHAPError_Busy because no space was available.
+     */
+    uint32_t numBusyWrites;
+
+    /**
+     * Number of writes that wrote fewer bytes than requested.
+     */
+    uint32_t numShortWrites;
+} HAPPlatformTCPStreamCounters;
+
+/**
+ * Statistics of an open TCP stream.
+ */
+typedef struct {
+    /**
+     * TCP stream.
+     */
+    HAPPlatformTCPStreamRef tcpStream;
+
+    /**
+     * I/O counters of the TCP stream.
+     */
+    HAPPlatformTCPStreamCounters counters;
+
+    /**
+     * Time since the TCP stream has been accepted.
+     */
+    HAPTime lifetime;
+} HAPPlatformTCPStreamStatistics;
+
+/**
+ * TCP stream manager statistics.
+ */
+typedef struct {
+    /**
+     * Number of accepted TCP streams.
+     */
+    uint32_t numAcceptedTCPStreams;
+
+    /**
+     * Number of connections that could not be accepted because the maximum number of concurrent TCP streams
+     * was reached.
+     */
+    uint32_t numRefusedTCPStreams;
+
+    /**
+     * Number of closed TCP streams.
+     */
+    uint32_t numClosedTCPStreams;
+
+    /**
+     * Number of TCP streams that have been closed by the eviction callback to admit a new connection.
+     */
+    uint32_t numEvictedTCPStreams;
+
+    /**
+     * Sum of the lifetimes of closed TCP streams.
+     */
+    HAPTime totalLifetime;
+
+    /**
+     * Longest lifetime of a closed TCP stream.
+     */
+    HAPTime maxLifetime;
+
+    /**
+     * I/O counters accumulated over all TCP streams, including TCP streams that have been closed.
+     */
+    HAPPlatformTCPStreamCounters counters;
+
+    /**
+     * Number of readiness events of the TCP stream listener socket.
+     */
+    uint32_t numAcceptEvents;
+
+    /**
+     * Largest number of TCP streams accepted in a single readiness event.
+     */
+    uint32_t maxAcceptsPerEvent;
+
+    /**
+     * Number of TCP streams for which the accept latency has been recorded.
+     */
+    uint32_t numAcceptLatencySamples;
+
+    /**
+     * Sum of accept latencies in microseconds.
+     *
+     * - The accept latency is measured from the readiness event of the TCP stream listener socket that led to
+     *   accepting a TCP stream until the first successful read on that TCP stream.
+     */
+    uint64_t totalAcceptLatency;
+
+    /**
+     * Largest accept latency in microseconds.
+     */
+    uint64_t maxAcceptLatency;
+} HAPPlatformTCPStreamManagerStatistics;
+
 // Opaque type. Do not use directly.
 /**@cond */
 typedef struct {
@@ -89,12 +369,15 @@ typedef struct {
     HAPPlatformFileHandleRef fileHandle;
     HAPPlatformTCPStreamListenerCallback _Nullable callback;
     void* _Nullable context;
+
+    uint64_t readyTime;
 } HAPPlatformTCPStreamListener;
 /**@endcond */
 
 // Opaque type. Do not use directly.
 /**@cond */
-typedef struct {
+typedef struct HAPPlatformTCPStream HAPPlatformTCPStream;
+struct HAPPlatformTCPStream {
     HAPPlatformTCPStreamManagerRef tcpStreamManager;
 
     int fileDescriptor;
@@ -102,7 +385,15 @@ typedef struct {
     HAPPlatformTCPStreamEvent interests;
     HAPPlatformTCPStreamEventCallback _Nullable callback;
     void* _Nullable context;
-} HAPPlatformTCPStream;
+
+    uint64_t acceptTime;
+    HAPTime openTime;
+    HAPTime lastActivityTime;
+    HAPPlatformTCPStreamCounters counters;
+
+    HAPPlatformTCPStream* _Nullable prevTCPStream;
+    HAPPlatformTCPStream* _Nullable nextTCPStream;
+};
 /**@endcond */
 
 /**
@@ -113,16 +404,60 @@ struct HAPPlatformTCPStreamManager {
     /**@cond */
     size_t numTCPStreams;
     size_t maxTCPStreams;
+    bool batchAccept;
 
     struct {
         HAPNetworkPort port;
+        int backlog;
     } tcpStreamListenerConfiguration;
 
+    struct {
+        int receiveBufferSize;
+        int sendBufferSize;
+        bool keepAliveIsEnabled;
+        int keepAliveIdleTime;
+        int keepAliveInterval;
+        int keepAliveCount;
+        unsigned int userTimeout;
+        bool resetsConnectionOnClose;
+    } tcpStreamConfiguration;
+
+    struct {
+        HAPPlatformTCPStreamManagerEvictionCallback _Nullable callback;
+        void* _Nullable context;
+        HAPTime minIdleTime;
+        HAPPlatformTimerRef retryTimer;
+    } eviction;
+
     HAPPlatformTCPStreamListener tcpStreamListener;
     HAPPlatformTCPStream* _Nullable tcpStreams;
+    HAPPlatformTCPStream* _Nullable freeTCPStreams;
+    HAPPlatformTCPStream* _Nullable activeTCPStreams;
+
+    HAPPlatformTCPStreamManagerStatistics statistics;
     /**@endcond */
 };
 
+/**
+ * Maximum number of buffers that may be passed to HAPPlatformTCPStreamWritev.
+ */
+#define kHAPPlatformTCPStream_MaxWriteBuffers ((size_t) 16)
+
+/**
+ * Buffer for HAPPlatformTCPStreamWritev.
+ */
+typedef struct {
+    /**
+     * Data to write.
+     */
+    const void* _Nullable bytes;
+
+    /**
+     * Length of data.
+     */
+    size_t numBytes;
+} HAPPlatformTCPStreamWriteBuffer;
+
 /**
  * Initializes TCP stream manager.
  *
@@ -142,6 +477,60 @@ void HAPPlatformTCPStreamManagerCreate(
  */
 void HAPPlatformTCPStreamManagerRelease(HAPPlatformTCPStreamManagerRef tcpStreamManager);
 
+/**
+ * Gets the statistics of a TCP stream manager.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param[out] statistics           Statistics.
+ */
+void HAPPlatformTCPStreamManagerGetStatistics(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamManagerStatistics* statistics);
+
+/**
+ * Gets a snapshot of the statistics of all open TCP streams.
+ *
+ * - TCP streams are reported from the most recently accepted to the least recently accepted one.
+ *   If there are more open TCP streams than maxStatistics, only the most recently accepted ones are reported.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param[out] statistics           Statistics, one element per open TCP stream.
+ * @param      maxStatistics        Capacity of the statistics buffer.
+ * @param[out] numStatistics        Number of elements that have been filled in.
+ */
+void HAPPlatformTCPStreamManagerGetTCPStreamStatistics(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamStatistics* statistics,
+        size_t maxStatistics,
+        size_t* numStatistics);
+
+/**
+ * Writes data from multiple buffers to a TCP stream with a single system call.
+ *
+ * - This behaves like HAPPlatformTCPStreamWrite with the concatenation of the buffers, but avoids copying them into
+ *   a contiguous staging buffer, e.g., for HTTP headers followed by a body or for multiple encrypted frames.
+ *
+ * - Like HAPPlatformTCPStreamWrite, fewer bytes than requested may be written. The remaining bytes must be written
+ *   once the TCP stream has space available again.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param      tcpStream            TCP stream.
+ * @param      buffers              Buffers to write, in order.
+ * @param      numBuffers           Number of buffers. At most kHAPPlatformTCPStream_MaxWriteBuffers.
+ * @param[out] numBytes             Number of bytes that have been written.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If an I/O error occurred.
+ * @return kHAPError_Busy           If no data can be written at this time. Retry later.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamWritev(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamRef tcpStream,
+        const HAPPlatformTCPStreamWriteBuffer* buffers,
+        size_t numBuffers,
+        size_t* numBytes);
+
 #if __has_feature(nullability)
 #pragma clang assume_nonnull end
 #endif
@@ -0,0 +1,167 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HAP_PLATFORM_WORK_QUEUE_INIT_H
+#define HAP_PLATFORM_WORK_QUEUE_INIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "HAPPlatform.h"
+#include "HAPPlatformRunLoop+Init.h"
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull begin
+#endif
+
+/**@file
+ * Work queue that offloads CPU-heavy work from the run loop to worker tasks.
+ *
+ * Work items are executed by a pool of FreeRTOS worker tasks. On dual-core targets the workers are pinned to the core
+ * that does not run the run loop. Once a work item has been executed, its completion callback is invoked on the run
+ * loop that submitted it through HAPPlatformRunLoopScheduleCallbackByReferenceOnInstance. While the scheduled callback
+ * queue of that run loop is full, the worker task waits with exponential backoff and does not execute other work items.
+ *
+ * - The work callback must not call any ADK or platform functions that are restricted to the run loop.
+ * - The work item must stay valid until its completion callback has been invoked.
+ *
+ * **Example**
+
+   @code{.c}
+   static HAPPlatformWork work;
+
+   static void ComputeVerifier(HAPPlatformWork* work, void* _Nullable context) {
+       // Runs on a worker task.
+   }
+
+   static void HandleVerifierComputed(HAPPlatformWork* work, void* _Nullable context) {
+       // Runs on the run loop.
+   }
+
+   HAPError err = HAPPlatformWorkSubmit(&work, ComputeVerifier, HandleVerifierComputed, context);
+
+   @endcode
+ */
+
+/**
+ * Default number of work items that may be pending at a time.
+ */
+#define kHAPPlatformWorkQueue_DefaultMaxPendingWork ((size_t) 8)
+
+typedef struct HAPPlatformWork HAPPlatformWork;
+
+/**
+ * Callback that executes a work item on a worker task.
+ *
+ * @param      work                 Work item.
+ * @param      context              The context parameter given to the HAPPlatformWorkSubmit function.
+ */
+typedef void (*HAPPlatformWorkCallback)(HAPPlatformWork* work, void* _Nullable context);
+
+/**
+ * Callback that is invoked on the run loop once a work item has been executed.
+ *
+ * @param      work                 Work item.
+ * @param      context              The context parameter given to the HAPPlatformWorkSubmit function.
+ */
+typedef void (*HAPPlatformWorkCompletionCallback)(HAPPlatformWork* work, void* _Nullable context);
+
+/**
+ * Work item.
+ */
+struct HAPPlatformWork {
+    // Opaque type. Do not access the instance fields directly.
+    /**@cond */
+    HAPPlatformWorkCallback _Nullable callback;
+    HAPPlatformWorkCompletionCallback _Nullable completionCallback;
+    void* _Nullable context;
+    HAPPlatformRunLoopRef _Nullable runLoop;
+    HAPPlatformWork* _Nullable nextWork;
+    /**@endcond */
+};
+
+/**
+ * Work queue initialization options.
+ */
+typedef struct {
+    /**
+     * Number of worker tasks.
+     *
+     * - If 0, CONFIG_HAP_WORK_QUEUE_NUM_WORKERS worker tasks are created.
+     */
+    size_t numWorkers;
+
+    /**
+     * Maximum number of work items that may be pending at a time.
+     *
+     * - A work item is pending from its submission until a worker task starts executing it.
+     *
+     * - If 0, kHAPPlatformWorkQueue_DefaultMaxPendingWork work items may be pending.
+     */
+    size_t maxPendingWork;
+} HAPPlatformWorkQueueOptions;
+
+/**
+ * Creates the work queue and starts its worker tasks.
+ *
+ * - The run loop must be created before the work queue.
+ *
+ * @param      options              Initialization options.
+ */
+void HAPPlatformWorkQueueCreate(const HAPPlatformWorkQueueOptions* options);
+
+/**
+ * Stops the worker tasks and releases the work queue.
+ *
+ * - This function must be called on the run loop.
+ *
+ * - Work items that are still pending are executed before the worker tasks stop. Their completion callbacks are
+ *   invoked once the run loop processes scheduled callbacks again.
+ *
+ * - Completions that cannot be scheduled because the scheduled callback queue of this run loop is full are invoked by
+ *   this function after the worker tasks have stopped. These completion callbacks must not submit work items.
+ */
+void HAPPlatformWorkQueueRelease(void);
+
+/**
+ * Submits a work item.
+ *
+ * - This function must be called on the run loop.
+ *
+ * @param      work                 Work item. Must stay valid until the completion callback has been invoked.
+ * @param      callback             Function to call on a worker task.
+ * @param      completionCallback   Function to call on the run loop once the work item has been executed. It is
+ *                                  invoked on the run loop instance that submitted the work item.
+ * @param      context              Context that is passed to the callbacks.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If too many work items are pending.
+ */
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformWorkSubmit(
+        HAPPlatformWork* work,
+        HAPPlatformWorkCallback callback,
+        HAPPlatformWorkCompletionCallback completionCallback,
+        void* _Nullable context);
+
+#if __has_feature(nullability)
+#pragma clang assume_nonnull end
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
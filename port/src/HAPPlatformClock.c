@@ -22,10 +22,42 @@
 #include <sys/time.h>
 #include <time.h>
 
+#include <esp_timer.h>
+
 #include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
 
 static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "Clock" };
 
+#if HAVE_VIRTUAL_CLOCK
+/**
+ * Virtual time. Only modified on the run loop thread, but may be read from any thread.
+ */
+static HAPTime virtualNow;
+
+HAPTime HAPPlatformClockGetCurrent(void) {
+    return __atomic_load_n(&virtualNow, __ATOMIC_ACQUIRE);
+}
+
+void HAPPlatformClockSetVirtualTime(HAPTime now) {
+    HAPTime previousNow = __atomic_load_n(&virtualNow, __ATOMIC_ACQUIRE);
+    HAPPrecondition(now >= previousNow);
+
+    // Check for overflow.
+    if (now & (1ull << 63)) {
+        HAPLog(&logObject, "Time overflowed (capped at 2^63 - 1).");
+        HAPFatalError();
+    }
+
+    __atomic_store_n(&virtualNow, now, __ATOMIC_RELEASE);
+}
+
+void HAPPlatformClockAdvanceVirtualTime(HAPTime delta) {
+    HAPTime now = __atomic_load_n(&virtualNow, __ATOMIC_ACQUIRE);
+    HAPPrecondition(delta <= UINT64_MAX - now);
+    HAPPlatformClockSetVirtualTime(now + delta);
+}
+#else
 HAPTime HAPPlatformClockGetCurrent(void) {
     int e;
 
@@ -94,3 +126,52 @@ HAPTime HAPPlatformClockGetCurrent(void) {
     previousNow = now;
     return now;
 }
+#endif
+
+/**
+ * Time of the current run loop iteration.
+ *
+ * - Each run loop instance runs on its own thread, so the cached time is kept per thread.
+ */
+static __thread HAPTime loopTime;
+
+/**
+ * Whether loopTime has been initialized. 0 is a valid time, e.g., when the virtual clock is used.
+ */
+static __thread bool isLoopTimeValid;
+
+HAP_RESULT_USE_CHECK
+HAPTime HAPPlatformClockGetLoopTime(void) {
+    if (!isLoopTimeValid) {
+        return HAPPlatformClockUpdateLoopTime();
+    }
+    return loopTime;
+}
+
+HAPTime HAPPlatformClockUpdateLoopTime(void) {
+    loopTime = HAPPlatformClockGetCurrent();
+    isLoopTimeValid = true;
+    return loopTime;
+}
+
+HAP_RESULT_USE_CHECK
+uint64_t HAPPlatformClockGetCurrentMicroseconds(void) {
+    return (uint64_t) esp_timer_get_time();
+}
+
+HAP_RESULT_USE_CHECK
+uint64_t HAPPlatformClockGetCurrentNanoseconds(void) {
+#if defined(CLOCK_MONOTONIC)
+    struct timespec t;
+    int e = clock_gettime(CLOCK_MONOTONIC, &t);
+    if (e) {
+        int _errno = errno;
+        HAPAssert(e == -1);
+        HAPLogError(&logObject, "clock_gettime failed: %d.", _errno);
+        HAPFatalError();
+    }
+    return (uint64_t) t.tv_sec * 1000000000 + (uint64_t) t.tv_nsec;
+#else
+    return HAPPlatformClockGetCurrentMicroseconds() * 1000;
+#endif
+}
@@ -18,17 +18,20 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-// This implementation is based on `select` for maximum portability but may be extended to also support
-// `poll`, `epoll` or `kqueue`.
+// This implementation is based on `select` for maximum portability. The I/O multiplexer is accessed through the
+// Multiplexer* functions below, and `poll` or, on Linux host builds, `epoll` may be selected instead through the
+// HAP_RUN_LOOP_MULTIPLEXER option.
 
 #include "HAPPlatform.h"
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
 #include <sys/select.h>
 
 #include "HAPPlatform+Init.h"
+#include "HAPPlatformClock+Init.h"
 #include "HAPPlatformFileHandle.h"
 #include "HAPPlatformLog+Init.h"
 #include "HAPPlatformRunLoop+Init.h"
@@ -39,9 +42,61 @@
 #include <lwip/sockets.h>
 #include <sys/syslimits.h>
 
+#if defined(CONFIG_HAP_RUN_LOOP_MULTIPLEXER_EPOLL)
+#define HAP_RUN_LOOP_USE_SELECT 0
+#define HAP_RUN_LOOP_USE_POLL   0
+#define HAP_RUN_LOOP_USE_EPOLL  1
+#include <sys/epoll.h>
+#elif defined(CONFIG_HAP_RUN_LOOP_MULTIPLEXER_POLL)
+#define HAP_RUN_LOOP_USE_SELECT 0
+#define HAP_RUN_LOOP_USE_POLL   1
+#define HAP_RUN_LOOP_USE_EPOLL  0
+#include <poll.h>
+#else
+#define HAP_RUN_LOOP_USE_SELECT 1
+#define HAP_RUN_LOOP_USE_POLL   0
+#define HAP_RUN_LOOP_USE_EPOLL  0
+#endif
+
+#if HAVE_RUN_LOOP_WATCHDOG
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#endif
+
 static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "RunLoop" };
 
-#define LOOPBACK_PORT   12321
+/**
+ * Capacity of the scheduled callback queue. Must be a power of two.
+ */
+#ifdef CONFIG_HAP_RUN_LOOP_CALLBACK_QUEUE_SIZE
+#define kHAPPlatformRunLoop_NumScheduledCallbacks ((uint32_t) CONFIG_HAP_RUN_LOOP_CALLBACK_QUEUE_SIZE)
+#else
+#define kHAPPlatformRunLoop_NumScheduledCallbacks ((uint32_t) 16)
+#endif
+HAP_STATIC_ASSERT(
+        kHAPPlatformRunLoop_NumScheduledCallbacks &&
+                !(kHAPPlatformRunLoop_NumScheduledCallbacks & (kHAPPlatformRunLoop_NumScheduledCallbacks - 1)),
+        kHAPPlatformRunLoop_NumScheduledCallbacks_IsPowerOfTwo);
+
+/**
+ * Capacity of the urgent scheduled callback queue. Must be a power of two.
+ */
+#ifdef CONFIG_HAP_RUN_LOOP_URGENT_CALLBACK_QUEUE_SIZE
+#define kHAPPlatformRunLoop_NumUrgentScheduledCallbacks ((uint32_t) CONFIG_HAP_RUN_LOOP_URGENT_CALLBACK_QUEUE_SIZE)
+#else
+#define kHAPPlatformRunLoop_NumUrgentScheduledCallbacks ((uint32_t) 4)
+#endif
+HAP_STATIC_ASSERT(
+        kHAPPlatformRunLoop_NumUrgentScheduledCallbacks &&
+                !(kHAPPlatformRunLoop_NumUrgentScheduledCallbacks &
+                  (kHAPPlatformRunLoop_NumUrgentScheduledCallbacks - 1)),
+        kHAPPlatformRunLoop_NumUrgentScheduledCallbacks_IsPowerOfTwo);
+
+/**
+ * Number of scheduled callback priorities.
+ */
+#define kHAPPlatformRunLoop_NumCallbackPriorities ((size_t) 2)
 
 /**
  * Internal file handle type, representing the registration of a platform-specific file descriptor.
@@ -83,9 +138,36 @@ struct HAPPlatformFileHandle {
     HAPPlatformFileHandle* _Nullable nextFileHandle;
 
     /**
-     * Flag indicating whether the platform-specific file descriptor is registered with an I/O multiplexer or not.
+     * Events that have been reported by the I/O multiplexer but that have not been dispatched yet.
+     */
+    HAPPlatformFileHandleEvent pendingEvents;
+
+    /**
+     * Flag indicating whether the file handle is in the list of file handles with pending events.
+     */
+    bool isPending;
+
+    /**
+     * Previous file handle in list of file handles with pending events.
+     */
+    HAPPlatformFileHandle* _Nullable prevPendingFileHandle;
+
+    /**
+     * Next file handle in list of file handles with pending events.
+     */
+    HAPPlatformFileHandle* _Nullable nextPendingFileHandle;
+
+#if HAP_RUN_LOOP_USE_POLL
+    /**
+     * Index of the file descriptor in the poll file descriptor array.
+     */
+    size_t pollIndex;
+#elif HAP_RUN_LOOP_USE_EPOLL
+    /**
+     * Whether the file descriptor has been added to the epoll instance. It is only added while it has interests.
      */
-    bool isAwaitingEvents;
+    bool isInEpollSet;
+#endif
 };
 
 /**
@@ -102,6 +184,21 @@ struct HAPPlatformTimer {
      */
     HAPTime deadline;
 
+    /**
+     * Latest time at which the timer fires. Equal to the deadline unless the timer has a tolerance.
+     */
+    HAPTime latestDeadline;
+
+    /**
+     * Time in milliseconds by which the timer may be fired after its deadline.
+     */
+    HAPTime tolerance;
+
+    /**
+     * Period in milliseconds after which a periodic timer is re-armed. 0 for one-shot timers.
+     */
+    HAPTime period;
+
     /**
      * Callback that is invoked when the timer expires.
      */
@@ -113,11 +210,176 @@ struct HAPPlatformTimer {
     void* _Nullable context;
 
     /**
-     * Next timer in linked list.
+     * Registration sequence number, used to fire timers with the same deadline in order of registration.
      */
-    HAPPlatformTimer* _Nullable nextTimer;
+    uint64_t sequenceNumber;
+
+    /**
+     * Index of the timer in the timer heap.
+     */
+    size_t heapIndex;
+
+    /**
+     * Reference that has been returned to the client.
+     */
+    HAPPlatformTimerRef ref;
+
+    /**
+     * Whether the timer has been deregistered while its callback is being invoked.
+     */
+    bool isDeregistered : 1;
 };
 
+/**
+ * Header that precedes each object of a run loop object pool.
+ */
+typedef struct {
+    /**
+     * Index of the object in its pool.
+     */
+    uint32_t index;
+
+    /**
+     * Generation of the object. Incremented whenever the object is freed.
+     */
+    uint32_t generation;
+} HAPPlatformRunLoopPoolSlotHeader;
+
+/**
+ * Pool of fixed-size run loop objects.
+ *
+ * - Objects are carved out of slabs and recycled through an intrusive free list.
+ *   The first slab is allocated when the run loop is created. If heap overflow is allowed, further slabs of the same
+ *   size are allocated once all objects are in use, up to the maximum capacity of the pool. The last slab is
+ *   truncated to the maximum capacity. Slabs are only released together with the run loop.
+ *
+ * - Objects are numbered consecutively across slabs, so an object index stays valid for the lifetime of the pool.
+ *   All slabs but the last have the same size, so an index is resolved to its object arithmetically. The index and
+ *   the generation of an object are stored in a slot header in front of the object, so they are found in constant
+ *   time as well. Together, they allow handing out references that can be checked for staleness after the object has
+ *   been freed.
+ *
+ * - Once the generation of an object reaches the maximum generation of the pool, the object is retired instead of
+ *   being reused, so that a stale reference never resolves to a newer object.
+ */
+typedef struct {
+    /**
+     * Size of an object, including padding for alignment.
+     */
+    size_t elementSize;
+
+    /**
+     * Size of an object including its slot header.
+     */
+    size_t slotSize;
+
+    /**
+     * Number of objects per slab.
+     */
+    size_t numElementsPerSlab;
+
+    /**
+     * Maximum number of objects in the pool, including retired objects.
+     */
+    size_t maxCapacity;
+
+    /**
+     * Allocated slabs.
+     */
+    void* _Nullable* _Nullable slabs;
+
+    /**
+     * Number of allocated slabs.
+     */
+    size_t numSlabs;
+
+    /**
+     * Free list. The first bytes of a free object link to the next free object.
+     */
+    void* _Nullable freeElements;
+
+    /**
+     * Generation at which an object is retired.
+     */
+    uint32_t maxGeneration;
+
+    /**
+     * Statistics.
+     */
+    HAPPlatformRunLoopObjectPoolStatistics statistics;
+
+    /**
+     * Whether additional slabs may be allocated.
+     */
+    bool allowsHeapOverflow;
+} HAPPlatformRunLoopPool;
+
+/**
+ * Slot of a scheduled callback queue.
+ */
+typedef struct {
+    /**
+     * Sequence number of the slot.
+     */
+    uint32_t sequenceNumber;
+
+    /**
+     * Coalescing key. 0 if the callback is not coalesced.
+     */
+    uint32_t coalescingKey;
+
+    /**
+     * Callback to invoke.
+     */
+    HAPPlatformRunLoopCallback _Nullable callback;
+
+    /**
+     * Context size.
+     */
+    size_t contextSize;
+
+    /**
+     * Context that is passed by reference. NULL if the context is stored in the slot.
+     */
+    void* _Nullable contextReference;
+
+    /**
+     * Context. Callbacks are invoked with a pointer into the slot, so the context is 8-byte aligned.
+     */
+    HAP_ALIGNAS(8)
+    char context[UINT8_MAX];
+} HAPPlatformRunLoopScheduledCallback;
+
+/**
+ * Scheduled callback queue.
+ *
+ * The queue is a bounded multi-producer / single-consumer ring. Each slot carries a sequence number that tells
+ * producers and the consumer whether the slot is free for a given enqueue position or holds a published callback.
+ * - Free for enqueue position p: sequenceNumber == p.
+ * - Published at enqueue position p: sequenceNumber == p + 1.
+ */
+typedef struct {
+    /**
+     * Slots.
+     */
+    HAPPlatformRunLoopScheduledCallback* _Nullable slots;
+
+    /**
+     * Number of slots. Must be a power of two.
+     */
+    uint32_t numSlots;
+
+    /**
+     * Next enqueue position. Shared between producers.
+     */
+    uint32_t enqueuePosition;
+
+    /**
+     * Next dequeue position. Only accessed by the run loop.
+     */
+    uint32_t dequeuePosition;
+} HAPPlatformRunLoopCallbackQueue;
+
 /**
  * Run loop state.
  */
@@ -137,7 +399,17 @@ HAP_ENUM_BEGIN(uint8_t, HAPPlatformRunLoopState) { /**
                                                    kHAPPlatformRunLoopState_Stopping
 } HAP_ENUM_END(uint8_t, HAPPlatformRunLoopState);
 
-static struct {
+struct HAPPlatformRunLoop {
+    /**
+     * Pool of file handles.
+     */
+    HAPPlatformRunLoopPool fileHandlePool;
+
+    /**
+     * Pool of timers.
+     */
+    HAPPlatformRunLoopPool timerPool;
+
     /**
      * Sentinel node of a circular doubly-linked list of file handles
      */
@@ -149,252 +421,2475 @@ static struct {
     HAPPlatformFileHandle* _Nullable fileHandles;
 
     /**
-     * File handle cursor, used to handle reentrant modifications of global file handle list during iteration.
+     * First file handle with pending events, in order in which the events were reported.
      */
-    HAPPlatformFileHandle* _Nullable fileHandleCursor;
+    HAPPlatformFileHandle* _Nullable pendingFileHandles;
 
     /**
-     * Start of linked list of timers, ordered by deadline.
+     * Last file handle with pending events.
      */
-    HAPPlatformTimer* _Nullable timers;
-    
+    HAPPlatformFileHandle* _Nullable lastPendingFileHandle;
+
+#if HAP_RUN_LOOP_USE_POLL
     /**
-     * Loopback file descriptor to receive data.
+     * Poll file descriptor array. Entries for file handles without interests have a negative file descriptor.
      */
-    volatile int loopbackFileDescriptor;
+    struct pollfd* _Nullable pollFileDescriptors;
 
     /**
-     * Self-pipe byte buffer.
-     *
-     * - Callbacks are serialized into the buffer as:
-     *   - 8-byte aligned callback pointer.
-     *   - Context size (up to UINT8_MAX).
-     *   - Context (unaligned). When invoking the callback, the context is first moved to be 8-byte aligned.
+     * File handles corresponding to the entries of the poll file descriptor array.
      */
-    HAP_ALIGNAS(8)
-    char loopbackBytes[sizeof(HAPPlatformRunLoopCallback) + 1 + UINT8_MAX];
+    HAPPlatformFileHandle* _Nullable* _Nullable pollFileHandles;
 
     /**
-     * Number of bytes in self-pipe byte buffer.
+     * Number of used entries in the poll file descriptor array.
      */
-    size_t numLoopbackBytes;
+    size_t numPollFileDescriptors;
 
     /**
-     * File handle for self-pipe.
+     * Capacity of the poll file descriptor array.
      */
-    HAPPlatformFileHandleRef loopbackFileHandle;
-
+    size_t maxPollFileDescriptors;
+#elif HAP_RUN_LOOP_USE_EPOLL
     /**
-     * Current run loop state.
+     * Epoll instance. -1 until the first file handle is registered.
      */
-    HAPPlatformRunLoopState state;
-} runLoop = { .fileHandleSentinel = { .fileDescriptor = -1,
-                                      .interests = { .isReadyForReading = false,
-                                                     .isReadyForWriting = false,
-                                                     .hasErrorConditionPending = false },
-                                      .callback = NULL,
-                                      .context = NULL,
-                                      .prevFileHandle = &runLoop.fileHandleSentinel,
-                                      .nextFileHandle = &runLoop.fileHandleSentinel,
-                                      .isAwaitingEvents = false },
-              .fileHandles = &runLoop.fileHandleSentinel,
-              .fileHandleCursor = &runLoop.fileHandleSentinel,
+    int epollFileDescriptor;
 
-              .timers = NULL,
+    /**
+     * Buffer for the events that are returned by epoll_wait.
+     */
+    struct epoll_event* _Nullable epollEvents;
 
-              .loopbackFileDescriptor = -1 };
+    /**
+     * Capacity of the epoll event buffer.
+     */
+    size_t maxEpollEvents;
 
-HAP_RESULT_USE_CHECK
-HAPError HAPPlatformFileHandleRegister(
-        HAPPlatformFileHandleRef* fileHandle_,
-        int fileDescriptor,
-        HAPPlatformFileHandleEvent interests,
-        HAPPlatformFileHandleCallback callback,
-        void* _Nullable context) {
-    HAPPrecondition(fileHandle_);
+    /**
+     * Number of file handles that are registered with the epoll backend.
+     */
+    size_t numEpollFileHandles;
+#else
+    /**
+     * File descriptors of file handles that are interested in reading.
+     */
+    fd_set readFileDescriptors;
 
-    // Prepare fileHandle.
-    HAPPlatformFileHandle* fileHandle = calloc(1, sizeof(HAPPlatformFileHandle));
-    if (!fileHandle) {
-        HAPLog(&logObject, "Cannot allocate more file handles.");
-        *fileHandle_ = 0;
-        return kHAPError_OutOfResources;
-    }
-    fileHandle->fileDescriptor = fileDescriptor;
-    fileHandle->interests = interests;
-    fileHandle->callback = callback;
-    fileHandle->context = context;
-    fileHandle->prevFileHandle = runLoop.fileHandles->prevFileHandle;
-    fileHandle->nextFileHandle = runLoop.fileHandles;
-    fileHandle->isAwaitingEvents = false;
-    runLoop.fileHandles->prevFileHandle->nextFileHandle = fileHandle;
-    runLoop.fileHandles->prevFileHandle = fileHandle;
+    /**
+     * File descriptors of file handles that are interested in writing.
+     */
+    fd_set writeFileDescriptors;
 
-    *fileHandle_ = (HAPPlatformFileHandleRef) fileHandle;
-    return kHAPError_None;
-}
+    /**
+     * File descriptors of file handles that are interested in error conditions.
+     */
+    fd_set errorFileDescriptors;
 
-void HAPPlatformFileHandleUpdateInterests(
-        HAPPlatformFileHandleRef fileHandle_,
-        HAPPlatformFileHandleEvent interests,
-        HAPPlatformFileHandleCallback callback,
-        void* _Nullable context) {
-    HAPPrecondition(fileHandle_);
-    HAPPlatformFileHandle* fileHandle = (HAPPlatformFileHandle * _Nonnull) fileHandle_;
+    /**
+     * Highest file descriptor in any of the file descriptor sets. -1 if all sets are empty.
+     */
+    int maxFileDescriptor;
 
-    fileHandle->interests = interests;
-    fileHandle->callback = callback;
-    fileHandle->context = context;
-}
+    /**
+     * Whether maxFileDescriptor needs to be recomputed because its file handle lost all interests.
+     */
+    bool isMaxFileDescriptorDirty;
 
-void HAPPlatformFileHandleDeregister(HAPPlatformFileHandleRef fileHandle_) {
-    HAPPrecondition(fileHandle_);
-    HAPPlatformFileHandle* fileHandle = (HAPPlatformFileHandle * _Nonnull) fileHandle_;
+    /**
+     * Number of file handles with at least one interest.
+     */
+    size_t numInterestedFileHandles;
 
-    HAPPrecondition(fileHandle->prevFileHandle);
-    HAPPrecondition(fileHandle->nextFileHandle);
+    /**
+     * File handles indexed by file descriptor.
+     */
+    HAPPlatformFileHandle* _Nullable fileHandlesByFileDescriptor[FD_SETSIZE];
+#endif
 
-    if (fileHandle == runLoop.fileHandleCursor) {
-        runLoop.fileHandleCursor = fileHandle->nextFileHandle;
-    }
+    /**
+     * Binary min-heap of timers, ordered by latest deadline and registration sequence number.
+     */
+    HAPPlatformTimer* _Nullable* _Nullable timers;
 
-    fileHandle->prevFileHandle->nextFileHandle = fileHandle->nextFileHandle;
-    fileHandle->nextFileHandle->prevFileHandle = fileHandle->prevFileHandle;
+    /**
+     * Number of timers in the timer heap.
+     */
+    size_t numTimers;
 
-    fileHandle->fileDescriptor = -1;
-    fileHandle->interests.isReadyForReading = false;
-    fileHandle->interests.isReadyForWriting = false;
-    fileHandle->interests.hasErrorConditionPending = false;
-    fileHandle->callback = NULL;
-    fileHandle->context = NULL;
-    fileHandle->nextFileHandle = NULL;
-    fileHandle->prevFileHandle = NULL;
-    fileHandle->isAwaitingEvents = false;
-    HAPPlatformFreeSafe(fileHandle);
-}
-
-static void ProcessSelectedFileHandles(
-        fd_set* readFileDescriptors,
-        fd_set* writeFileDescriptors,
-        fd_set* errorFileDescriptors) {
-    HAPPrecondition(readFileDescriptors);
-    HAPPrecondition(writeFileDescriptors);
-    HAPPrecondition(errorFileDescriptors);
-
-    runLoop.fileHandleCursor = runLoop.fileHandles->nextFileHandle;
-    while (runLoop.fileHandleCursor != runLoop.fileHandles) {
-        HAPPlatformFileHandle* fileHandle = runLoop.fileHandleCursor;
-        runLoop.fileHandleCursor = fileHandle->nextFileHandle;
-
-        if (fileHandle->isAwaitingEvents) {
-            HAPAssert(fileHandle->fileDescriptor != -1);
-            fileHandle->isAwaitingEvents = false;
-            if (fileHandle->callback) {
-                HAPPlatformFileHandleEvent fileHandleEvents;
-                fileHandleEvents.isReadyForReading = fileHandle->interests.isReadyForReading &&
-                                                     FD_ISSET(fileHandle->fileDescriptor, readFileDescriptors);
-                fileHandleEvents.isReadyForWriting = fileHandle->interests.isReadyForWriting &&
-                                                     FD_ISSET(fileHandle->fileDescriptor, writeFileDescriptors);
-                fileHandleEvents.hasErrorConditionPending = fileHandle->interests.hasErrorConditionPending &&
-                                                            FD_ISSET(fileHandle->fileDescriptor, errorFileDescriptors);
-
-                if (fileHandleEvents.isReadyForReading || fileHandleEvents.isReadyForWriting ||
-                    fileHandleEvents.hasErrorConditionPending) {
-                    fileHandle->callback((HAPPlatformFileHandleRef) fileHandle, fileHandleEvents, fileHandle->context);
-                }
-            }
-        }
-    }
-}
+    /**
+     * Capacity of the timer heap.
+     */
+    size_t maxTimers;
 
-HAP_RESULT_USE_CHECK
-HAPError HAPPlatformTimerRegister(
-        HAPPlatformTimerRef* timer_,
-        HAPTime deadline,
-        HAPPlatformTimerCallback callback,
-        void* _Nullable context) {
-    HAPPrecondition(timer_);
-    HAPPlatformTimer* _Nullable* newTimer = (HAPPlatformTimer * _Nullable*) timer_;
-    HAPPrecondition(callback);
+    /**
+     * Sequence number of the next registered timer.
+     */
+    uint64_t nextTimerSequenceNumber;
+    
+    /**
+     * Storage of the normal scheduled callback queue.
+     */
+    HAPPlatformRunLoopScheduledCallback scheduledCallbacks[kHAPPlatformRunLoop_NumScheduledCallbacks];
 
-    // Prepare timer.
-    *newTimer = calloc(1, sizeof(HAPPlatformTimer));
-    if (!*newTimer) {
-        HAPLog(&logObject, "Cannot allocate more timers.");
-        return kHAPError_OutOfResources;
-    }
-    (*newTimer)->deadline = deadline ? deadline : 1;
-    (*newTimer)->callback = callback;
-    (*newTimer)->context = context;
+    /**
+     * Storage of the urgent scheduled callback queue.
+     */
+    HAPPlatformRunLoopScheduledCallback urgentScheduledCallbacks[kHAPPlatformRunLoop_NumUrgentScheduledCallbacks];
 
-    // Insert timer.
-    for (HAPPlatformTimer* _Nullable* nextTimer = &runLoop.timers;; nextTimer = &(*nextTimer)->nextTimer) {
-        if (!*nextTimer) {
-            (*newTimer)->nextTimer = NULL;
-            *nextTimer = *newTimer;
-            break;
-        }
-        if ((*nextTimer)->deadline > deadline) {
-            // Search condition must be '>' and not '>=' to ensure that timers fire in ascending order of their
-            // deadlines and that timers registered with the same deadline fire in order of registration.
-            (*newTimer)->nextTimer = *nextTimer;
-            *nextTimer = *newTimer;
-            break;
-        }
-    }
+    /**
+     * Scheduled callback queues, indexed by priority.
+     */
+    HAPPlatformRunLoopCallbackQueue callbackQueues[kHAPPlatformRunLoop_NumCallbackPriorities];
 
-    return kHAPError_None;
-}
+    /**
+     * Non-zero if a wakeup has been sent on the loopback and the run loop has not yet consumed it.
+     *
+     * - Producers only send a wakeup when this flag transitions from zero, so bursts cost a single datagram.
+     */
+    uint32_t isWakeupPending;
 
-void HAPPlatformTimerDeregister(HAPPlatformTimerRef timer_) {
-    HAPPrecondition(timer_);
-    HAPPlatformTimer* timer = (HAPPlatformTimer*) timer_;
+    /**
+     * Loopback file descriptor to receive wakeups.
+     */
+    volatile int loopbackFileDescriptor;
 
-    // Find and remove timer.
-    for (HAPPlatformTimer* _Nullable* nextTimer = &runLoop.timers; *nextTimer; nextTimer = &(*nextTimer)->nextTimer) {
-        if (*nextTimer == timer) {
-            *nextTimer = timer->nextTimer;
-            HAPPlatformFreeSafe(timer);
-            return;
-        }
-    }
+    /**
+     * Loopback file descriptor to send wakeups, connected to the receiving loopback file descriptor.
+     */
+    volatile int loopbackSendFileDescriptor;
 
-    // Timer not found.
-    HAPFatalError();
-}
+    /**
+     * File handle for loopback.
+     */
+    HAPPlatformFileHandleRef loopbackFileHandle;
 
-static void ProcessExpiredTimers(void) {
-    // Get current time.
-    HAPTime now = HAPPlatformClockGetCurrent();
+    /**
+     * Whether the order in which ready file handles are dispatched is rotated every run loop iteration.
+     */
+    bool rotatesFileHandleDispatch;
+
+    /**
+     * Offset at which the multiplexer starts scanning for ready file handles.
+     */
+    size_t fileHandleScanOffset;
+
+    /**
+     * Time budget in milliseconds for dispatching file handle callbacks per run loop iteration. 0 if unlimited.
+     */
+    HAPTime fileHandleDispatchBudget;
+
+    /**
+     * Time in microseconds at which the file handle dispatch budget of the current run loop iteration is exhausted.
+     */
+    uint64_t fileHandleDispatchDeadline;
+
+    /**
+     * First registered idle task.
+     */
+    HAPPlatformRunLoopIdleTask* _Nullable idleTasks;
+
+    /**
+     * Idle task that is invoked next. NULL to start with the first registered idle task.
+     */
+    HAPPlatformRunLoopIdleTask* _Nullable nextIdleTask;
+
+    /**
+     * Number of registered idle tasks with pending work.
+     */
+    size_t numPendingIdleTasks;
+
+    /**
+     * Minimum time in milliseconds until the next timer deadline for idle tasks to run.
+     */
+    HAPTime idleTaskMargin;
+
+    /**
+     * Time budget in milliseconds for idle tasks per run loop iteration.
+     */
+    HAPTime idleTaskBudget;
+
+    /**
+     * Current run loop state.
+     */
+    HAPPlatformRunLoopState state;
+
+#if HAVE_RUN_LOOP_STATISTICS
+    /**
+     * Run loop statistics.
+     */
+    HAPPlatformRunLoopStatistics statistics;
+#endif
+
+#if HAVE_RUN_LOOP_WATCHDOG
+    /**
+     * Callback that is currently being dispatched. Written by the run loop and read by the watchdog task.
+     *
+     * - The record is protected by a sequence lock. The sequence number is odd while the record is being written.
+     *   Every dispatch starts with a distinct sequence number.
+     */
+    struct {
+        /**
+         * Sequence number.
+         */
+        uint32_t sequenceNumber;
+
+        /**
+         * Callback type. 0 if no callback is being dispatched.
+         */
+        HAPPlatformRunLoopCallbackType type;
+
+        /**
+         * Address of the callback function.
+         */
+        const void* _Nullable callback;
+
+        /**
+         * Time at which the callback was invoked, from HAPPlatformClockGetCurrentMicroseconds.
+         */
+        uint64_t startTime;
+    } dispatch;
+
+    /**
+     * Run loop watchdog.
+     */
+    struct {
+        /**
+         * Watchdog task. A task notification requests it to stop.
+         */
+        TaskHandle_t _Nullable task;
+
+        /**
+         * Binary semaphore that is given by the watchdog task when it stops.
+         */
+        SemaphoreHandle_t _Nullable stopped;
+
+        /**
+         * Mutex that protects the statistics.
+         */
+        SemaphoreHandle_t _Nullable mutex;
+
+        /**
+         * Sequence number of the dispatch for which the last stall has been recorded.
+         */
+        uint32_t lastStallSequenceNumber;
+
+        /**
+         * Statistics.
+         */
+        HAPPlatformRunLoopWatchdogStatistics statistics;
+    } watchdog;
+#endif
+};
+
+/**
+ * Run loop that is used by threads that are not bound to a run loop instance.
+ */
+static HAPPlatformRunLoop defaultRunLoop = {
+    .fileHandleSentinel = { .fileDescriptor = -1,
+                            .interests = { .isReadyForReading = false,
+                                           .isReadyForWriting = false,
+                                           .hasErrorConditionPending = false },
+                            .callback = NULL,
+                            .context = NULL,
+                            .prevFileHandle = &defaultRunLoop.fileHandleSentinel,
+                            .nextFileHandle = &defaultRunLoop.fileHandleSentinel },
+    .fileHandles = &defaultRunLoop.fileHandleSentinel,
+    .pendingFileHandles = NULL,
+    .lastPendingFileHandle = NULL,
+#if HAP_RUN_LOOP_USE_SELECT
+    .maxFileDescriptor = -1,
+#elif HAP_RUN_LOOP_USE_EPOLL
+    .epollFileDescriptor = -1,
+#endif
+
+    .timers = NULL,
+    .numTimers = 0,
+    .maxTimers = 0,
+    .nextTimerSequenceNumber = 0,
+
+    .loopbackFileDescriptor = -1,
+    .loopbackSendFileDescriptor = -1
+};
+
+/**
+ * Run loop instance that is bound to the current thread. NULL if the default run loop is used.
+ */
+static __thread HAPPlatformRunLoop* _Nullable currentRunLoop;
+
+/**
+ * Returns the run loop of the current thread.
+ *
+ * @return Run loop instance that is bound to the current thread, or the default run loop.
+ */
+HAP_RESULT_USE_CHECK
+static HAPPlatformRunLoop* GetCurrentRunLoop(void) {
+    return currentRunLoop ? HAPNonnull(currentRunLoop) : &defaultRunLoop;
+}
+
+#if HAVE_RUN_LOOP_STATISTICS
+/**
+ * Records a value in a histogram.
+ *
+ * @param      histogram            Histogram.
+ * @param      value                Value.
+ */
+static void RecordHistogramValue(HAPPlatformRunLoopHistogram* histogram, uint64_t value) {
+    HAPPrecondition(histogram);
+
+    size_t bucket = 0;
+    while (bucket < kHAPPlatformRunLoopHistogram_NumBuckets - 1 && value >= ((uint64_t) 1 << bucket)) {
+        bucket++;
+    }
+    histogram->buckets[bucket]++;
+    histogram->numValues++;
+    histogram->sum += value;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+/**
+ * Records the invocation of a callback.
+ *
+ * @param      type                 Callback type.
+ * @param      callback             Address of the callback function.
+ * @param      startTime            Time at which the callback was invoked, from HAPPlatformClockGetCurrentMicroseconds.
+ */
+static void RecordCallbackInvocation(HAPPlatformRunLoopCallbackType type, const void* callback, uint64_t startTime) {
+    HAPPrecondition(callback);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    uint64_t endTime = HAPPlatformClockGetCurrentMicroseconds();
+    uint64_t duration = endTime > startTime ? endTime - startTime : 0;
+
+    switch (type) {
+        case kHAPPlatformRunLoopCallbackType_FileHandle: {
+            RecordHistogramValue(&runLoop->statistics.fileHandleCallbackDuration, duration);
+        } break;
+        case kHAPPlatformRunLoopCallbackType_Timer: {
+            RecordHistogramValue(&runLoop->statistics.timerCallbackDuration, duration);
+        } break;
+        case kHAPPlatformRunLoopCallbackType_Scheduled: {
+            RecordHistogramValue(&runLoop->statistics.scheduledCallbackDuration, duration);
+        } break;
+        case kHAPPlatformRunLoopCallbackType_Idle: {
+            RecordHistogramValue(&runLoop->statistics.idleTaskDuration, duration);
+        } break;
+        default:
+            HAPFatalError();
+    }
+
+    HAPPlatformRunLoopCallbackStatistics* callbackStatistics = NULL;
+    for (size_t i = 0; i < runLoop->statistics.numCallbacks; i++) {
+        if (runLoop->statistics.callbacks[i].callback == callback && runLoop->statistics.callbacks[i].type == type) {
+            callbackStatistics = &runLoop->statistics.callbacks[i];
+            break;
+        }
+    }
+    if (!callbackStatistics) {
+        if (runLoop->statistics.numCallbacks == kHAPPlatformRunLoopStatistics_MaxCallbacks) {
+            runLoop->statistics.numUntrackedCallbackInvocations++;
+            return;
+        }
+        callbackStatistics = &runLoop->statistics.callbacks[runLoop->statistics.numCallbacks];
+        runLoop->statistics.numCallbacks++;
+        callbackStatistics->callback = callback;
+        callbackStatistics->type = type;
+    }
+    callbackStatistics->numInvocations++;
+    callbackStatistics->totalDuration += duration;
+    if (duration > callbackStatistics->maxDuration) {
+        callbackStatistics->maxDuration = duration;
+    }
+}
+
+void HAPPlatformRunLoopGetStatistics(HAPPlatformRunLoopStatistics* statistics) {
+    HAPPrecondition(statistics);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    *statistics = runLoop->statistics;
+}
+
+void HAPPlatformRunLoopResetStatistics(void) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPRawBufferZero(&runLoop->statistics, sizeof runLoop->statistics);
+}
+#endif
+
+#if HAVE_RUN_LOOP_WATCHDOG
+/**
+ * Interval at which the watchdog task checks the current dispatch, in milliseconds.
+ */
+#define kHAPPlatformRunLoopWatchdog_CheckInterval \
+    ((CONFIG_HAP_RUN_LOOP_WATCHDOG_THRESHOLD_MS + 3) / 4)
+
+/**
+ * Records that the run loop starts dispatching a callback.
+ *
+ * @param      type                 Callback type.
+ * @param      callback             Address of the callback function.
+ */
+static void BeginDispatch(HAPPlatformRunLoopCallbackType type, const void* callback) {
+    HAPPrecondition(type);
+    HAPPrecondition(callback);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    uint32_t sequenceNumber = runLoop->dispatch.sequenceNumber;
+    __atomic_store_n(&runLoop->dispatch.sequenceNumber, sequenceNumber + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&runLoop->dispatch.type, type, __ATOMIC_RELAXED);
+    __atomic_store_n(&runLoop->dispatch.callback, callback, __ATOMIC_RELAXED);
+    __atomic_store_n(&runLoop->dispatch.startTime, HAPPlatformClockGetCurrentMicroseconds(), __ATOMIC_RELAXED);
+    __atomic_store_n(&runLoop->dispatch.sequenceNumber, sequenceNumber + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * Records that the run loop has finished dispatching a callback.
+ */
+static void EndDispatch(void) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    uint32_t sequenceNumber = runLoop->dispatch.sequenceNumber;
+    __atomic_store_n(&runLoop->dispatch.sequenceNumber, sequenceNumber + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&runLoop->dispatch.type, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&runLoop->dispatch.callback, NULL, __ATOMIC_RELAXED);
+    __atomic_store_n(&runLoop->dispatch.startTime, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&runLoop->dispatch.sequenceNumber, sequenceNumber + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * Returns a description of a callback type for logging.
+ *
+ * @param      type                 Callback type.
+ *
+ * @return Description of the callback type.
+ */
+HAP_RESULT_USE_CHECK
+static const char* GetCallbackTypeDescription(HAPPlatformRunLoopCallbackType type) {
+    switch (type) {
+        case kHAPPlatformRunLoopCallbackType_FileHandle: {
+            return "file handle";
+        }
+        case kHAPPlatformRunLoopCallbackType_Timer: {
+            return "timer";
+        }
+        case kHAPPlatformRunLoopCallbackType_Scheduled: {
+            return "scheduled";
+        }
+        case kHAPPlatformRunLoopCallbackType_Idle: {
+            return "idle";
+        }
+    }
+    HAPFatalError();
+}
+
+/**
+ * Watchdog task. Periodically checks whether the current dispatch exceeds the stall threshold until it receives a
+ * stop request.
+ *
+ * @param      context              Run loop.
+ */
+static void WatchdogTask(void* _Nullable context) {
+    HAPPrecondition(context);
+    HAPPlatformRunLoop* runLoop = context;
+
+    for (;;) {
+        if (ulTaskNotifyTake(
+                    pdTRUE, HAPMax(pdMS_TO_TICKS(kHAPPlatformRunLoopWatchdog_CheckInterval), (TickType_t) 1))) {
+            break;
+        }
+
+        // Take a snapshot of the current dispatch. If the run loop is updating it, the check is skipped, as the
+        // dispatch is making progress.
+        uint32_t sequenceNumber = __atomic_load_n(&runLoop->dispatch.sequenceNumber, __ATOMIC_ACQUIRE);
+        HAPPlatformRunLoopStall stall;
+        stall.type = __atomic_load_n(&runLoop->dispatch.type, __ATOMIC_RELAXED);
+        stall.callback = __atomic_load_n(&runLoop->dispatch.callback, __ATOMIC_RELAXED);
+        stall.startTime = __atomic_load_n(&runLoop->dispatch.startTime, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if ((sequenceNumber & 1) ||
+            sequenceNumber != __atomic_load_n(&runLoop->dispatch.sequenceNumber, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        if (!stall.type) {
+            continue;
+        }
+
+        uint64_t now = HAPPlatformClockGetCurrentMicroseconds();
+        stall.duration = now > stall.startTime ? now - stall.startTime : 0;
+        if (stall.duration < (uint64_t) CONFIG_HAP_RUN_LOOP_WATCHDOG_THRESHOLD_MS * 1000) {
+            continue;
+        }
+
+        xSemaphoreTake(runLoop->watchdog.mutex, portMAX_DELAY);
+        bool isNewStall = sequenceNumber != runLoop->watchdog.lastStallSequenceNumber;
+        if (isNewStall) {
+            runLoop->watchdog.lastStallSequenceNumber = sequenceNumber;
+            runLoop->watchdog.statistics.numStalls++;
+        }
+        runLoop->watchdog.statistics.lastStall = stall;
+        if (stall.duration > runLoop->watchdog.statistics.longestStall.duration) {
+            runLoop->watchdog.statistics.longestStall = stall;
+        }
+        xSemaphoreGive(runLoop->watchdog.mutex);
+
+        if (isNewStall) {
+            HAPLogError(
+                    &logObject,
+                    "Run loop stalled: %s callback %p has been executing for %lu ms.",
+                    GetCallbackTypeDescription(stall.type),
+                    stall.callback,
+                    (unsigned long) (stall.duration / 1000));
+        }
+    }
+
+    // The run loop may be released as soon as the semaphore is given, so it must not be accessed afterwards.
+    xSemaphoreGive(runLoop->watchdog.stopped);
+    vTaskDelete(NULL);
+}
+
+/**
+ * Starts the watchdog task.
+ */
+static void StartWatchdog(void) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPrecondition(!runLoop->watchdog.task);
+
+    HAPRawBufferZero(&runLoop->watchdog, sizeof runLoop->watchdog);
+    runLoop->watchdog.mutex = xSemaphoreCreateMutex();
+    runLoop->watchdog.stopped = xSemaphoreCreateBinary();
+    if (!runLoop->watchdog.mutex || !runLoop->watchdog.stopped) {
+        HAPLogError(&logObject, "Cannot create run loop watchdog semaphores.");
+        HAPFatalError();
+    }
+    if (xTaskCreate(
+                WatchdogTask,
+                "hap_watchdog",
+                3 * 1024,
+                runLoop,
+                CONFIG_HAP_RUN_LOOP_WATCHDOG_TASK_PRIORITY,
+                &runLoop->watchdog.task) != pdPASS) {
+        HAPLogError(&logObject, "Cannot create run loop watchdog task.");
+        HAPFatalError();
+    }
+}
+
+/**
+ * Stops the watchdog task.
+ *
+ * - The watchdog task is requested to stop and deletes itself, so that it is never deleted while it holds a lock,
+ *   e.g., while logging. This function waits until it has stopped.
+ */
+static void StopWatchdog(void) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    if (!runLoop->watchdog.task) {
+        return;
+    }
+
+    xTaskNotifyGive(runLoop->watchdog.task);
+    xSemaphoreTake(runLoop->watchdog.stopped, portMAX_DELAY);
+    runLoop->watchdog.task = NULL;
+
+    vSemaphoreDelete(runLoop->watchdog.stopped);
+    runLoop->watchdog.stopped = NULL;
+    vSemaphoreDelete(runLoop->watchdog.mutex);
+    runLoop->watchdog.mutex = NULL;
+}
+
+void HAPPlatformRunLoopGetWatchdogStatistics(HAPPlatformRunLoopWatchdogStatistics* statistics) {
+    HAPPrecondition(statistics);
+
+    HAPPlatformRunLoopGetWatchdogStatisticsOfInstance(GetCurrentRunLoop(), statistics);
+}
+
+void HAPPlatformRunLoopGetWatchdogStatisticsOfInstance(
+        HAPPlatformRunLoopRef runLoop,
+        HAPPlatformRunLoopWatchdogStatistics* statistics) {
+    HAPPrecondition(runLoop);
+    HAPPrecondition(statistics);
+    HAPPrecondition(runLoop->watchdog.mutex);
+
+    xSemaphoreTake(runLoop->watchdog.mutex, portMAX_DELAY);
+    *statistics = runLoop->watchdog.statistics;
+    xSemaphoreGive(runLoop->watchdog.mutex);
+}
+#endif
+
+/**
+ * Appends a slab to a pool and adds its objects to the free list.
+ *
+ * @param      pool                 Pool.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the slab could not be allocated.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError AppendPoolSlab(HAPPlatformRunLoopPool* pool) {
+    HAPPrecondition(pool);
+    HAPPrecondition(pool->elementSize);
+    HAPPrecondition(pool->numElementsPerSlab);
+
+    size_t capacity = pool->statistics.capacity;
+    if (capacity >= pool->maxCapacity) {
+        return kHAPError_OutOfResources;
+    }
+    size_t numElements = HAPMin(pool->numElementsPerSlab, pool->maxCapacity - capacity);
+
+    void* _Nullable* slabs = realloc(pool->slabs, (pool->numSlabs + 1) * sizeof *slabs);
+    if (!slabs) {
+        return kHAPError_OutOfResources;
+    }
+    pool->slabs = slabs;
+
+    char* slab = malloc(numElements * pool->slotSize);
+    if (!slab) {
+        return kHAPError_OutOfResources;
+    }
+    pool->slabs[pool->numSlabs] = slab;
+    pool->numSlabs++;
+
+    // Link objects in ascending address order.
+    for (size_t i = numElements; i; i--) {
+        HAPPlatformRunLoopPoolSlotHeader* header = (void*) &slab[(i - 1) * pool->slotSize];
+        header->index = (uint32_t)(capacity + i - 1);
+        header->generation = 0;
+        void* element = &header[1];
+        *(void* _Nullable*) element = pool->freeElements;
+        pool->freeElements = element;
+    }
+    pool->statistics.capacity += numElements;
+    pool->statistics.numSlabs = pool->numSlabs;
+    return kHAPError_None;
+}
+
+/**
+ * Initializes a pool and allocates its first slab.
+ *
+ * @param      pool                 Pool.
+ * @param      elementSize          Size of an object.
+ * @param      numElementsPerSlab   Number of objects per slab.
+ * @param      maxCapacity          Maximum number of objects, at most UINT32_MAX.
+ * @param      maxGeneration        Generation at which an object is retired.
+ * @param      allowsHeapOverflow   Whether additional slabs may be allocated.
+ */
+static void CreatePool(
+        HAPPlatformRunLoopPool* pool,
+        size_t elementSize,
+        size_t numElementsPerSlab,
+        size_t maxCapacity,
+        uint32_t maxGeneration,
+        bool allowsHeapOverflow) {
+    HAPPrecondition(pool);
+    HAPPrecondition(!pool->numSlabs);
+    HAPPrecondition(elementSize);
+    HAPPrecondition(numElementsPerSlab);
+    HAPPrecondition(maxCapacity && maxCapacity <= UINT32_MAX);
+    HAPPrecondition(maxGeneration);
+
+    HAPRawBufferZero(pool, sizeof *pool);
+    pool->elementSize = HAPMax(elementSize, sizeof(void*));
+    pool->elementSize = (pool->elementSize + 7) & ~(size_t) 7;
+    pool->slotSize = sizeof(HAPPlatformRunLoopPoolSlotHeader) + pool->elementSize;
+    pool->numElementsPerSlab = numElementsPerSlab;
+    pool->maxCapacity = maxCapacity;
+    pool->maxGeneration = maxGeneration;
+    pool->allowsHeapOverflow = allowsHeapOverflow;
+
+    HAPError err = AppendPoolSlab(pool);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        HAPLogError(&logObject, "Cannot allocate run loop object pool.");
+        HAPFatalError();
+    }
+}
+
+/**
+ * Releases the slabs of a pool.
+ *
+ * - Slabs are kept if objects are still in use.
+ *
+ * @param      pool                 Pool.
+ */
+static void ReleasePool(HAPPlatformRunLoopPool* pool) {
+    HAPPrecondition(pool);
+
+    if (pool->statistics.numElements) {
+        HAPLog(&logObject,
+               "Not releasing run loop object pool: %lu objects in use.",
+               (unsigned long) pool->statistics.numElements);
+        return;
+    }
+    for (size_t i = 0; i < pool->numSlabs; i++) {
+        HAPPlatformFreeSafe(pool->slabs[i]);
+    }
+    if (pool->slabs) {
+        HAPPlatformFreeSafe(pool->slabs);
+    }
+    HAPRawBufferZero(pool, sizeof *pool);
+}
+
+/**
+ * Allocates a zero-initialized object from a pool.
+ *
+ * @param      pool                 Pool.
+ *
+ * @return Object, if successful. NULL otherwise.
+ */
+HAP_RESULT_USE_CHECK
+static void* _Nullable AllocatePoolElement(HAPPlatformRunLoopPool* pool) {
+    HAPPrecondition(pool);
+    HAPPrecondition(pool->numSlabs);
+
+    if (!pool->freeElements) {
+        if (!pool->allowsHeapOverflow || AppendPoolSlab(pool) != kHAPError_None) {
+            pool->statistics.numFailedAllocations++;
+            return NULL;
+        }
+        HAPLogInfo(&logObject,
+                   "Run loop object pool grown to %lu objects.",
+                   (unsigned long) pool->statistics.capacity);
+    }
+
+    void* element = HAPNonnullVoid(pool->freeElements);
+    pool->freeElements = *(void* _Nullable*) element;
+    HAPRawBufferZero(element, pool->elementSize);
+
+    pool->statistics.numElements++;
+    if (pool->statistics.numElements > pool->statistics.maxElements) {
+        pool->statistics.maxElements = pool->statistics.numElements;
+    }
+    return element;
+}
+
+/**
+ * Returns the slot header of an object.
+ *
+ * @param      element              Object that has been allocated from a pool.
+ *
+ * @return Slot header of the object.
+ */
+HAP_RESULT_USE_CHECK
+static HAPPlatformRunLoopPoolSlotHeader* GetPoolSlotHeader(const void* element) {
+    HAPPrecondition(element);
+
+    return &((HAPPlatformRunLoopPoolSlotHeader*) (uintptr_t) element)[-1];
+}
+
+/**
+ * Returns the index of an object in its pool.
+ *
+ * @param      pool                 Pool.
+ * @param      element              Object that has been allocated from the pool.
+ *
+ * @return Index of the object.
+ */
+HAP_RESULT_USE_CHECK
+static size_t GetPoolElementIndex(const HAPPlatformRunLoopPool* pool, const void* element) {
+    HAPPrecondition(pool);
+    HAPPrecondition(element);
+
+    size_t index = GetPoolSlotHeader(element)->index;
+    HAPAssert(index < pool->statistics.capacity);
+    return index;
+}
+
+/**
+ * Returns the generation of an object.
+ *
+ * @param      element              Object that has been allocated from a pool.
+ *
+ * @return Generation of the object.
+ */
+HAP_RESULT_USE_CHECK
+static uint32_t GetPoolElementGeneration(const void* element) {
+    HAPPrecondition(element);
+
+    return GetPoolSlotHeader(element)->generation;
+}
+
+/**
+ * Returns the object with a given index in a pool.
+ *
+ * @param      pool                 Pool.
+ * @param      index                Index of the object.
+ *
+ * @return Object.
+ */
+HAP_RESULT_USE_CHECK
+static void* GetPoolElement(const HAPPlatformRunLoopPool* pool, size_t index) {
+    HAPPrecondition(pool);
+    HAPPrecondition(index < pool->statistics.capacity);
+
+    char* slab = HAPNonnullVoid(HAPNonnull(pool->slabs)[index / pool->numElementsPerSlab]);
+    HAPPlatformRunLoopPoolSlotHeader* header = (void*) &slab[(index % pool->numElementsPerSlab) * pool->slotSize];
+    HAPAssert(header->index == index);
+    return &header[1];
+}
+
+/**
+ * Returns an object to its pool.
+ *
+ * - The object is retired instead if its generation reaches the maximum generation of the pool.
+ *
+ * @param      pool                 Pool.
+ * @param      element              Object that has been allocated from the pool.
+ */
+static void FreePoolElement(HAPPlatformRunLoopPool* pool, void* element) {
+    HAPPrecondition(pool);
+    HAPPrecondition(element);
+    HAPPrecondition(pool->statistics.numElements);
+
+    HAPPlatformRunLoopPoolSlotHeader* header = GetPoolSlotHeader(element);
+    HAPAssert(header->index < pool->statistics.capacity);
+    HAPAssert(header->generation < pool->maxGeneration);
+    header->generation++;
+    pool->statistics.numElements--;
+
+    if (header->generation == pool->maxGeneration) {
+        HAPLog(&logObject, "Retiring run loop object %lu: generation exhausted.", (unsigned long) header->index);
+        pool->statistics.numRetiredElements++;
+        return;
+    }
+    *(void* _Nullable*) element = pool->freeElements;
+    pool->freeElements = element;
+}
+
+void HAPPlatformRunLoopGetPoolStatistics(HAPPlatformRunLoopPoolStatistics* statistics) {
+    HAPPrecondition(statistics);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    statistics->fileHandles = runLoop->fileHandlePool.statistics;
+    statistics->timers = runLoop->timerPool.statistics;
+}
+
+/**
+ * Appends a file handle to the list of file handles with pending events.
+ *
+ * - If the file handle already has pending events, the new events are merged into the pending events.
+ *
+ * @param      fileHandle           File handle.
+ * @param      events               Events that occurred on the file descriptor.
+ */
+static void EnqueuePendingFileHandle(HAPPlatformFileHandle* fileHandle, HAPPlatformFileHandleEvent events) {
+    HAPPrecondition(fileHandle);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    if (fileHandle->isPending) {
+        fileHandle->pendingEvents.isReadyForReading |= events.isReadyForReading;
+        fileHandle->pendingEvents.isReadyForWriting |= events.isReadyForWriting;
+        fileHandle->pendingEvents.hasErrorConditionPending |= events.hasErrorConditionPending;
+        return;
+    }
+
+    fileHandle->pendingEvents = events;
+    fileHandle->isPending = true;
+    fileHandle->prevPendingFileHandle = runLoop->lastPendingFileHandle;
+    fileHandle->nextPendingFileHandle = NULL;
+    if (runLoop->lastPendingFileHandle) {
+        runLoop->lastPendingFileHandle->nextPendingFileHandle = fileHandle;
+    } else {
+        runLoop->pendingFileHandles = fileHandle;
+    }
+    runLoop->lastPendingFileHandle = fileHandle;
+}
+
+/**
+ * Removes a file handle from the list of file handles with pending events.
+ *
+ * @param      fileHandle           File handle with pending events.
+ */
+static void RemovePendingFileHandle(HAPPlatformFileHandle* fileHandle) {
+    HAPPrecondition(fileHandle);
+    HAPPrecondition(fileHandle->isPending);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    if (fileHandle->prevPendingFileHandle) {
+        fileHandle->prevPendingFileHandle->nextPendingFileHandle = fileHandle->nextPendingFileHandle;
+    } else {
+        runLoop->pendingFileHandles = fileHandle->nextPendingFileHandle;
+    }
+    if (fileHandle->nextPendingFileHandle) {
+        fileHandle->nextPendingFileHandle->prevPendingFileHandle = fileHandle->prevPendingFileHandle;
+    } else {
+        runLoop->lastPendingFileHandle = fileHandle->prevPendingFileHandle;
+    }
+
+    fileHandle->isPending = false;
+    fileHandle->pendingEvents.isReadyForReading = false;
+    fileHandle->pendingEvents.isReadyForWriting = false;
+    fileHandle->pendingEvents.hasErrorConditionPending = false;
+    fileHandle->prevPendingFileHandle = NULL;
+    fileHandle->nextPendingFileHandle = NULL;
+}
+
+#if HAP_RUN_LOOP_USE_POLL || HAP_RUN_LOOP_USE_EPOLL
+/**
+ * Checks whether a file descriptor is registered with the run loop.
+ *
+ * - Registrations are rare, so the list of file handles is searched linearly.
+ *
+ * @param      runLoop              Run loop.
+ * @param      fileDescriptor       File descriptor.
+ *
+ * @return true                     If a file handle for the file descriptor is registered.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+static bool IsFileDescriptorRegistered(const HAPPlatformRunLoop* runLoop, int fileDescriptor) {
+    HAPPrecondition(runLoop);
+
+    for (const HAPPlatformFileHandle* fileHandle = runLoop->fileHandles->nextFileHandle;
+         fileHandle != runLoop->fileHandles;
+         fileHandle = fileHandle->nextFileHandle) {
+        if (fileHandle->fileDescriptor == fileDescriptor) {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+#if HAP_RUN_LOOP_USE_POLL
+
+/**
+ * Converts file handle interests to poll events.
+ *
+ * @param      interests            Set of file handle events.
+ *
+ * @return Poll events.
+ */
+HAP_RESULT_USE_CHECK
+static short GetPollEvents(HAPPlatformFileHandleEvent interests) {
+    short events = 0;
+    if (interests.isReadyForReading) {
+        events |= POLLIN;
+    }
+    if (interests.isReadyForWriting) {
+        events |= POLLOUT;
+    }
+    if (interests.hasErrorConditionPending) {
+        events |= POLLPRI;
+    }
+    return events;
+}
+
+/**
+ * Updates the poll file descriptor array entry of a file handle from its interests.
+ *
+ * - File descriptors without interests are excluded by replacing them with -1, so that hang-ups are not reported.
+ *
+ * @param      fileHandle           File handle.
+ */
+static void MultiplexerUpdateFileHandle(HAPPlatformFileHandle* fileHandle) {
+    HAPPrecondition(fileHandle);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPrecondition(fileHandle->pollIndex < runLoop->numPollFileDescriptors);
+    HAPPrecondition(runLoop->pollFileHandles[fileHandle->pollIndex] == fileHandle);
+
+    struct pollfd* pollFileDescriptor = &runLoop->pollFileDescriptors[fileHandle->pollIndex];
+    pollFileDescriptor->events = GetPollEvents(fileHandle->interests);
+    pollFileDescriptor->fd = pollFileDescriptor->events ? fileHandle->fileDescriptor : -1;
+    pollFileDescriptor->revents = 0;
+}
+
+/**
+ * Registers a file handle with the I/O multiplexer.
+ *
+ * @param      fileHandle           File handle.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_InvalidState   If the file descriptor is already registered.
+ * @return kHAPError_OutOfResources If the poll file descriptor array could not be grown.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError MultiplexerRegisterFileHandle(HAPPlatformFileHandle* fileHandle) {
+    HAPPrecondition(fileHandle);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    if (IsFileDescriptorRegistered(runLoop, fileHandle->fileDescriptor)) {
+        HAPLogError(&logObject, "File descriptor %d is already registered.", fileHandle->fileDescriptor);
+        return kHAPError_InvalidState;
+    }
+
+    if (runLoop->numPollFileDescriptors == runLoop->maxPollFileDescriptors) {
+        size_t maxPollFileDescriptors = runLoop->maxPollFileDescriptors ? 2 * runLoop->maxPollFileDescriptors : 8;
+        struct pollfd* pollFileDescriptors =
+                realloc(runLoop->pollFileDescriptors, maxPollFileDescriptors * sizeof *pollFileDescriptors);
+        if (!pollFileDescriptors) {
+            HAPLog(&logObject, "Cannot grow poll file descriptor array.");
+            return kHAPError_OutOfResources;
+        }
+        runLoop->pollFileDescriptors = pollFileDescriptors;
+        HAPPlatformFileHandle* _Nullable* pollFileHandles =
+                realloc(runLoop->pollFileHandles, maxPollFileDescriptors * sizeof *pollFileHandles);
+        if (!pollFileHandles) {
+            HAPLog(&logObject, "Cannot grow poll file descriptor array.");
+            return kHAPError_OutOfResources;
+        }
+        runLoop->pollFileHandles = pollFileHandles;
+        runLoop->maxPollFileDescriptors = maxPollFileDescriptors;
+    }
+    HAPAssert(runLoop->numPollFileDescriptors < runLoop->maxPollFileDescriptors);
+
+    fileHandle->pollIndex = runLoop->numPollFileDescriptors;
+    runLoop->pollFileHandles[fileHandle->pollIndex] = fileHandle;
+    runLoop->numPollFileDescriptors++;
+    MultiplexerUpdateFileHandle(fileHandle);
+    return kHAPError_None;
+}
+
+/**
+ * Deregisters a file handle from the I/O multiplexer.
+ *
+ * - The last entry of the poll file descriptor array is moved into the freed entry.
+ *
+ * @param      fileHandle           File handle.
+ */
+static void MultiplexerDeregisterFileHandle(HAPPlatformFileHandle* fileHandle) {
+    HAPPrecondition(fileHandle);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPrecondition(fileHandle->pollIndex < runLoop->numPollFileDescriptors);
+    HAPPrecondition(runLoop->pollFileHandles[fileHandle->pollIndex] == fileHandle);
+
+    size_t lastIndex = runLoop->numPollFileDescriptors - 1;
+    if (fileHandle->pollIndex != lastIndex) {
+        HAPPlatformFileHandle* movedFileHandle = runLoop->pollFileHandles[lastIndex];
+        HAPAssert(movedFileHandle);
+        runLoop->pollFileDescriptors[fileHandle->pollIndex] = runLoop->pollFileDescriptors[lastIndex];
+        runLoop->pollFileHandles[fileHandle->pollIndex] = movedFileHandle;
+        movedFileHandle->pollIndex = fileHandle->pollIndex;
+    }
+    runLoop->pollFileHandles[lastIndex] = NULL;
+    runLoop->numPollFileDescriptors--;
+    fileHandle->pollIndex = 0;
+}
+
+/**
+ * Waits for events on the registered file descriptors and enqueues the file handles with pending events.
+ *
+ * @param      timeout              Maximum time to wait. NULL to wait indefinitely.
+ */
+static void MultiplexerWaitForEvents(const HAPTime* _Nullable timeout) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    int timeoutMilliseconds = -1;
+    if (timeout) {
+        timeoutMilliseconds = *timeout > INT_MAX ? INT_MAX : (int) *timeout;
+    }
+
+    int e = poll(runLoop->pollFileDescriptors, (nfds_t) runLoop->numPollFileDescriptors, timeoutMilliseconds);
+    if (e == -1 && errno == EINTR) {
+        return;
+    }
+    if (e < 0) {
+        int _errno = errno;
+        HAPAssert(e == -1);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error, "System call 'poll' failed.", _errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+
+    // Poll reports the number of entries with events, so the scan may stop once all of them have been found.
+    size_t numPollFileDescriptors = runLoop->numPollFileDescriptors;
+    size_t offset = numPollFileDescriptors ? runLoop->fileHandleScanOffset % numPollFileDescriptors : 0;
+    for (size_t j = 0; e > 0 && j < numPollFileDescriptors; j++) {
+        size_t i = (offset + j) % numPollFileDescriptors;
+        short revents = runLoop->pollFileDescriptors[i].revents;
+        if (!revents) {
+            continue;
+        }
+        runLoop->pollFileDescriptors[i].revents = 0;
+        e--;
+
+        HAPPlatformFileHandle* fileHandle = runLoop->pollFileHandles[i];
+        HAPAssert(fileHandle);
+
+        // Hang-ups and errors are reported as readiness, matching the behaviour of `select`.
+        HAPPlatformFileHandleEvent fileHandleEvents;
+        fileHandleEvents.isReadyForReading = fileHandle->interests.isReadyForReading &&
+                                             (revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL));
+        fileHandleEvents.isReadyForWriting = fileHandle->interests.isReadyForWriting &&
+                                             (revents & (POLLOUT | POLLHUP | POLLERR | POLLNVAL));
+        fileHandleEvents.hasErrorConditionPending = fileHandle->interests.hasErrorConditionPending &&
+                                                    (revents & POLLPRI);
+        if (fileHandleEvents.isReadyForReading || fileHandleEvents.isReadyForWriting ||
+            fileHandleEvents.hasErrorConditionPending) {
+            EnqueuePendingFileHandle(fileHandle, fileHandleEvents);
+        }
+    }
+}
+
+/**
+ * Releases resources of the I/O multiplexer.
+ */
+static void MultiplexerRelease(void) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    if (runLoop->numPollFileDescriptors) {
+        return;
+    }
+    if (runLoop->pollFileDescriptors) {
+        HAPPlatformFreeSafe(runLoop->pollFileDescriptors);
+    }
+    if (runLoop->pollFileHandles) {
+        HAPPlatformFreeSafe(runLoop->pollFileHandles);
+    }
+    runLoop->maxPollFileDescriptors = 0;
+}
+
+#elif HAP_RUN_LOOP_USE_EPOLL
+
+/**
+ * Converts file handle interests to epoll events.
+ *
+ * @param      interests            Set of file handle events.
+ *
+ * @return Epoll events.
+ */
+HAP_RESULT_USE_CHECK
+static uint32_t GetEpollEvents(HAPPlatformFileHandleEvent interests) {
+    uint32_t events = 0;
+    if (interests.isReadyForReading) {
+        events |= EPOLLIN;
+    }
+    if (interests.isReadyForWriting) {
+        events |= EPOLLOUT;
+    }
+    if (interests.hasErrorConditionPending) {
+        events |= EPOLLPRI;
+    }
+    return events;
+}
+
+/**
+ * Updates the epoll instance from the interests of a file handle.
+ *
+ * - File descriptors without interests are removed from the epoll instance, because epoll reports hang-ups and errors
+ *   regardless of the requested events.
+ *
+ * - File descriptors that have been closed while still registered are dropped from the epoll instance.
+ *
+ * @param      fileHandle           File handle.
+ */
+static void MultiplexerUpdateFileHandle(HAPPlatformFileHandle* fileHandle) {
+    HAPPrecondition(fileHandle);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPrecondition(runLoop->epollFileDescriptor != -1);
+
+    struct epoll_event event = { .events = GetEpollEvents(fileHandle->interests), .data.ptr = fileHandle };
+    int operation;
+    if (event.events) {
+        operation = fileHandle->isInEpollSet ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    } else if (fileHandle->isInEpollSet) {
+        operation = EPOLL_CTL_DEL;
+    } else {
+        return;
+    }
+
+    int e = epoll_ctl(runLoop->epollFileDescriptor, operation, fileHandle->fileDescriptor, &event);
+    if (e == -1 && (errno == EBADF || errno == ENOENT)) {
+        // The file descriptor has been closed while still registered, which removed it from the epoll instance.
+        // As with the other backends, this is not fatal. The file handle receives no events until it is deregistered.
+        if (operation != EPOLL_CTL_DEL) {
+            int _errno = errno;
+            HAPPlatformLogPOSIXError(
+                    kHAPLogType_Error,
+                    "System call 'epoll_ctl' failed for a closed file descriptor.",
+                    _errno,
+                    __func__,
+                    HAP_FILE,
+                    __LINE__);
+        }
+        fileHandle->isInEpollSet = false;
+        return;
+    }
+    if (e != 0) {
+        int _errno = errno;
+        HAPAssert(e == -1);
+        HAPPlatformLogPOSIXError(
+                kHAPLogType_Error, "System call 'epoll_ctl' failed.", _errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+    fileHandle->isInEpollSet = operation != EPOLL_CTL_DEL;
+}
+
+/**
+ * Registers a file handle with the I/O multiplexer.
+ *
+ * - The epoll instance is created when the first file handle is registered.
+ *
+ * @param      fileHandle           File handle.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_InvalidState   If the file descriptor is already registered.
+ * @return kHAPError_OutOfResources If the epoll instance could not be created or the event buffer could not be grown.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError MultiplexerRegisterFileHandle(HAPPlatformFileHandle* fileHandle) {
+    HAPPrecondition(fileHandle);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    // File descriptors without interests are not added to the epoll instance, so EEXIST cannot be relied upon.
+    if (IsFileDescriptorRegistered(runLoop, fileHandle->fileDescriptor)) {
+        HAPLogError(&logObject, "File descriptor %d is already registered.", fileHandle->fileDescriptor);
+        return kHAPError_InvalidState;
+    }
+
+    if (runLoop->epollFileDescriptor == -1) {
+        int fileDescriptor = epoll_create1(EPOLL_CLOEXEC);
+        if (fileDescriptor == -1) {
+            int _errno = errno;
+            HAPPlatformLogPOSIXError(
+                    kHAPLogType_Error, "System call 'epoll_create1' failed.", _errno, __func__, HAP_FILE, __LINE__);
+            return kHAPError_OutOfResources;
+        }
+        runLoop->epollFileDescriptor = fileDescriptor;
+    }
+    if (runLoop->numEpollFileHandles == runLoop->maxEpollEvents) {
+        size_t maxEpollEvents = runLoop->maxEpollEvents ? 2 * runLoop->maxEpollEvents : 8;
+        struct epoll_event* epollEvents = realloc(runLoop->epollEvents, maxEpollEvents * sizeof *epollEvents);
+        if (!epollEvents) {
+            HAPLog(&logObject, "Cannot grow epoll event buffer.");
+            return kHAPError_OutOfResources;
+        }
+        runLoop->epollEvents = epollEvents;
+        runLoop->maxEpollEvents = maxEpollEvents;
+    }
+    HAPAssert(runLoop->numEpollFileHandles < runLoop->maxEpollEvents);
+
+    fileHandle->isInEpollSet = false;
+    runLoop->numEpollFileHandles++;
+    MultiplexerUpdateFileHandle(fileHandle);
+    return kHAPError_None;
+}
+
+/**
+ * Deregisters a file handle from the I/O multiplexer.
+ *
+ * @param      fileHandle           File handle.
+ */
+static void MultiplexerDeregisterFileHandle(HAPPlatformFileHandle* fileHandle) {
+    HAPPrecondition(fileHandle);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPrecondition(runLoop->numEpollFileHandles);
+
+    fileHandle->interests.isReadyForReading = false;
+    fileHandle->interests.isReadyForWriting = false;
+    fileHandle->interests.hasErrorConditionPending = false;
+    MultiplexerUpdateFileHandle(fileHandle);
+    runLoop->numEpollFileHandles--;
+}
+
+/**
+ * Waits for events on the registered file descriptors and enqueues the file handles with pending events.
+ *
+ * - Only ready file descriptors are returned by the kernel, so the cost of a wait does not depend on the number of
+ *   registered file handles.
+ *
+ * @param      timeout              Maximum time to wait. NULL to wait indefinitely.
+ */
+static void MultiplexerWaitForEvents(const HAPTime* _Nullable timeout) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    int timeoutMilliseconds = -1;
+    if (timeout) {
+        timeoutMilliseconds = *timeout > INT_MAX ? INT_MAX : (int) *timeout;
+    }
+
+    // The loopback file handle is registered when the run loop is created, so the epoll instance exists.
+    HAPAssert(runLoop->epollFileDescriptor != -1);
+    HAPAssert(runLoop->maxEpollEvents);
+
+    int maxEvents = runLoop->maxEpollEvents > INT_MAX ? INT_MAX : (int) runLoop->maxEpollEvents;
+    int e = epoll_wait(runLoop->epollFileDescriptor, runLoop->epollEvents, maxEvents, timeoutMilliseconds);
+    if (e == -1 && errno == EINTR) {
+        return;
+    }
+    if (e < 0) {
+        int _errno = errno;
+        HAPAssert(e == -1);
+        HAPPlatformLogPOSIXError(
+                kHAPLogType_Error, "System call 'epoll_wait' failed.", _errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+
+    size_t numEvents = (size_t) e;
+    size_t offset = numEvents ? runLoop->fileHandleScanOffset % numEvents : 0;
+    for (size_t j = 0; j < numEvents; j++) {
+        const struct epoll_event* event = &runLoop->epollEvents[(offset + j) % numEvents];
+        HAPPlatformFileHandle* fileHandle = event->data.ptr;
+        HAPAssert(fileHandle);
+
+        // Hang-ups and errors are reported as readiness, matching the behaviour of `select`.
+        HAPPlatformFileHandleEvent fileHandleEvents;
+        fileHandleEvents.isReadyForReading = fileHandle->interests.isReadyForReading &&
+                                             (event->events & (EPOLLIN | EPOLLHUP | EPOLLERR));
+        fileHandleEvents.isReadyForWriting = fileHandle->interests.isReadyForWriting &&
+                                             (event->events & (EPOLLOUT | EPOLLHUP | EPOLLERR));
+        fileHandleEvents.hasErrorConditionPending = fileHandle->interests.hasErrorConditionPending &&
+                                                    (event->events & EPOLLPRI);
+        if (fileHandleEvents.isReadyForReading || fileHandleEvents.isReadyForWriting ||
+            fileHandleEvents.hasErrorConditionPending) {
+            EnqueuePendingFileHandle(fileHandle, fileHandleEvents);
+        }
+    }
+}
+
+/**
+ * Releases resources of the I/O multiplexer.
+ */
+static void MultiplexerRelease(void) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    if (runLoop->numEpollFileHandles) {
+        return;
+    }
+    if (runLoop->epollFileDescriptor != -1) {
+        int e = close(runLoop->epollFileDescriptor);
+        if (e != 0) {
+            int _errno = errno;
+            HAPAssert(e == -1);
+            HAPPlatformLogPOSIXError(
+                    kHAPLogType_Error, "Closing epoll instance failed.", _errno, __func__, HAP_FILE, __LINE__);
+        }
+        runLoop->epollFileDescriptor = -1;
+    }
+    if (runLoop->epollEvents) {
+        HAPPlatformFreeSafe(runLoop->epollEvents);
+    }
+    runLoop->maxEpollEvents = 0;
+}
+
+#else
+
+/**
+ * Updates the file descriptor sets from the interests of a file handle.
+ *
+ * @param      fileHandle           File handle.
+ */
+static void MultiplexerUpdateFileHandle(HAPPlatformFileHandle* fileHandle) {
+    HAPPrecondition(fileHandle);
+    HAPPrecondition(fileHandle->fileDescriptor >= 0);
+    HAPPrecondition(fileHandle->fileDescriptor < FD_SETSIZE);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPrecondition(runLoop->fileHandlesByFileDescriptor[fileHandle->fileDescriptor] == fileHandle);
+
+    int fileDescriptor = fileHandle->fileDescriptor;
+    bool wasInterested = FD_ISSET(fileDescriptor, &runLoop->readFileDescriptors) ||
+                         FD_ISSET(fileDescriptor, &runLoop->writeFileDescriptors) ||
+                         FD_ISSET(fileDescriptor, &runLoop->errorFileDescriptors);
+    bool isInterested = fileHandle->interests.isReadyForReading || fileHandle->interests.isReadyForWriting ||
+                        fileHandle->interests.hasErrorConditionPending;
+
+    if (fileHandle->interests.isReadyForReading) {
+        FD_SET(fileDescriptor, &runLoop->readFileDescriptors);
+    } else {
+        FD_CLR(fileDescriptor, &runLoop->readFileDescriptors);
+    }
+    if (fileHandle->interests.isReadyForWriting) {
+        FD_SET(fileDescriptor, &runLoop->writeFileDescriptors);
+    } else {
+        FD_CLR(fileDescriptor, &runLoop->writeFileDescriptors);
+    }
+    if (fileHandle->interests.hasErrorConditionPending) {
+        FD_SET(fileDescriptor, &runLoop->errorFileDescriptors);
+    } else {
+        FD_CLR(fileDescriptor, &runLoop->errorFileDescriptors);
+    }
+
+    if (isInterested && !wasInterested) {
+        runLoop->numInterestedFileHandles++;
+        if (fileDescriptor > runLoop->maxFileDescriptor) {
+            runLoop->maxFileDescriptor = fileDescriptor;
+        }
+    } else if (!isInterested && wasInterested) {
+        HAPAssert(runLoop->numInterestedFileHandles);
+        runLoop->numInterestedFileHandles--;
+        if (fileDescriptor == runLoop->maxFileDescriptor) {
+            runLoop->isMaxFileDescriptorDirty = true;
+        }
+    }
+}
+
+HAP_RESULT_USE_CHECK
+static HAPError MultiplexerRegisterFileHandle(HAPPlatformFileHandle* fileHandle) {
+    HAPPrecondition(fileHandle);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    if (fileHandle->fileDescriptor < 0 || fileHandle->fileDescriptor >= FD_SETSIZE) {
+        HAPLog(&logObject, "File descriptor %d exceeds FD_SETSIZE.", fileHandle->fileDescriptor);
+        return kHAPError_OutOfResources;
+    }
+    if (runLoop->fileHandlesByFileDescriptor[fileHandle->fileDescriptor]) {
+        HAPLogError(&logObject, "File descriptor %d is already registered.", fileHandle->fileDescriptor);
+        return kHAPError_InvalidState;
+    }
+
+    runLoop->fileHandlesByFileDescriptor[fileHandle->fileDescriptor] = fileHandle;
+    MultiplexerUpdateFileHandle(fileHandle);
+    return kHAPError_None;
+}
+
+static void MultiplexerDeregisterFileHandle(HAPPlatformFileHandle* fileHandle) {
+    HAPPrecondition(fileHandle);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    fileHandle->interests.isReadyForReading = false;
+    fileHandle->interests.isReadyForWriting = false;
+    fileHandle->interests.hasErrorConditionPending = false;
+    MultiplexerUpdateFileHandle(fileHandle);
+    runLoop->fileHandlesByFileDescriptor[fileHandle->fileDescriptor] = NULL;
+}
+
+/**
+ * Waits for events on the registered file descriptors and enqueues the file handles with pending events.
+ *
+ * - The file descriptor sets are maintained on registration changes and only copied here.
+ *
+ * @param      timeout              Maximum time to wait. NULL to wait indefinitely.
+ */
+static void MultiplexerWaitForEvents(const HAPTime* _Nullable timeout) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    if (runLoop->isMaxFileDescriptorDirty) {
+        while (runLoop->maxFileDescriptor >= 0 &&
+               !FD_ISSET(runLoop->maxFileDescriptor, &runLoop->readFileDescriptors) &&
+               !FD_ISSET(runLoop->maxFileDescriptor, &runLoop->writeFileDescriptors) &&
+               !FD_ISSET(runLoop->maxFileDescriptor, &runLoop->errorFileDescriptors)) {
+            runLoop->maxFileDescriptor--;
+        }
+        runLoop->isMaxFileDescriptorDirty = false;
+    }
+    HAPAssert(runLoop->maxFileDescriptor >= -1);
+    HAPAssert(runLoop->maxFileDescriptor < FD_SETSIZE);
+    HAPAssert(runLoop->numInterestedFileHandles || runLoop->maxFileDescriptor == -1);
+
+    fd_set readFileDescriptors = runLoop->readFileDescriptors;
+    fd_set writeFileDescriptors = runLoop->writeFileDescriptors;
+    fd_set errorFileDescriptors = runLoop->errorFileDescriptors;
+    int maxFileDescriptor = runLoop->maxFileDescriptor;
+
+    struct timeval timeoutValue;
+    if (timeout) {
+        timeoutValue.tv_sec = (time_t)(*timeout / 1000);
+        timeoutValue.tv_usec = (suseconds_t)((*timeout % 1000) * 1000);
+    }
+
+    int e = select(
+            maxFileDescriptor + 1,
+            &readFileDescriptors,
+            &writeFileDescriptors,
+            &errorFileDescriptors,
+            timeout ? &timeoutValue : NULL);
+    if (e == -1 && errno == EINTR) {
+        return;
+    }
+    if (e < 0) {
+        int _errno = errno;
+        HAPAssert(e == -1);
+        HAPPlatformLogPOSIXError(
+                kHAPLogType_Error, "System call 'select' failed.", _errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+
+    // Select reports the total number of set bits, so the scan may stop once all of them have been found.
+    size_t numFileDescriptors = (size_t)(maxFileDescriptor + 1);
+    size_t offset = numFileDescriptors ? runLoop->fileHandleScanOffset % numFileDescriptors : 0;
+    for (size_t i = 0; e > 0 && i < numFileDescriptors; i++) {
+        int fileDescriptor = (int) ((offset + i) % numFileDescriptors);
+        HAPPlatformFileHandleEvent fileHandleEvents;
+        fileHandleEvents.isReadyForReading = FD_ISSET(fileDescriptor, &readFileDescriptors);
+        fileHandleEvents.isReadyForWriting = FD_ISSET(fileDescriptor, &writeFileDescriptors);
+        fileHandleEvents.hasErrorConditionPending = FD_ISSET(fileDescriptor, &errorFileDescriptors);
+        if (!fileHandleEvents.isReadyForReading && !fileHandleEvents.isReadyForWriting &&
+            !fileHandleEvents.hasErrorConditionPending) {
+            continue;
+        }
+        e -= fileHandleEvents.isReadyForReading + fileHandleEvents.isReadyForWriting +
+             fileHandleEvents.hasErrorConditionPending;
+
+        HAPPlatformFileHandle* _Nullable fileHandle = runLoop->fileHandlesByFileDescriptor[fileDescriptor];
+        HAPAssert(fileHandle);
+        EnqueuePendingFileHandle(HAPNonnull(fileHandle), fileHandleEvents);
+    }
+}
+
+static void MultiplexerRelease(void) {
+}
+
+#endif
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformFileHandleRegister(
+        HAPPlatformFileHandleRef* fileHandle_,
+        int fileDescriptor,
+        HAPPlatformFileHandleEvent interests,
+        HAPPlatformFileHandleCallback callback,
+        void* _Nullable context) {
+    HAPPrecondition(fileHandle_);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    // Prepare fileHandle.
+    HAPPlatformFileHandle* fileHandle = AllocatePoolElement(&runLoop->fileHandlePool);
+    if (!fileHandle) {
+        HAPLog(&logObject, "Cannot allocate more file handles.");
+        *fileHandle_ = 0;
+        return kHAPError_OutOfResources;
+    }
+    fileHandle->fileDescriptor = fileDescriptor;
+    fileHandle->interests = interests;
+    fileHandle->callback = callback;
+    fileHandle->context = context;
+    fileHandle->isPending = false;
+
+    HAPError err = MultiplexerRegisterFileHandle(fileHandle);
+    if (err) {
+        HAPAssert(err == kHAPError_InvalidState || err == kHAPError_OutOfResources);
+        FreePoolElement(&runLoop->fileHandlePool, fileHandle);
+        *fileHandle_ = 0;
+        return err;
+    }
+
+    fileHandle->prevFileHandle = runLoop->fileHandles->prevFileHandle;
+    fileHandle->nextFileHandle = runLoop->fileHandles;
+    runLoop->fileHandles->prevFileHandle->nextFileHandle = fileHandle;
+    runLoop->fileHandles->prevFileHandle = fileHandle;
+
+    *fileHandle_ = (HAPPlatformFileHandleRef) fileHandle;
+    return kHAPError_None;
+}
+
+void HAPPlatformFileHandleUpdateInterests(
+        HAPPlatformFileHandleRef fileHandle_,
+        HAPPlatformFileHandleEvent interests,
+        HAPPlatformFileHandleCallback callback,
+        void* _Nullable context) {
+    HAPPrecondition(fileHandle_);
+    HAPPlatformFileHandle* fileHandle = (HAPPlatformFileHandle * _Nonnull) fileHandle_;
+
+    fileHandle->interests = interests;
+    fileHandle->callback = callback;
+    fileHandle->context = context;
+
+    MultiplexerUpdateFileHandle(fileHandle);
+}
+
+void HAPPlatformFileHandleDeregister(HAPPlatformFileHandleRef fileHandle_) {
+    HAPPrecondition(fileHandle_);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPlatformFileHandle* fileHandle = (HAPPlatformFileHandle * _Nonnull) fileHandle_;
+
+    HAPPrecondition(fileHandle->prevFileHandle);
+    HAPPrecondition(fileHandle->nextFileHandle);
+
+    if (fileHandle->isPending) {
+        RemovePendingFileHandle(fileHandle);
+    }
+    MultiplexerDeregisterFileHandle(fileHandle);
+
+    fileHandle->prevFileHandle->nextFileHandle = fileHandle->nextFileHandle;
+    fileHandle->nextFileHandle->prevFileHandle = fileHandle->prevFileHandle;
+
+    fileHandle->fileDescriptor = -1;
+    fileHandle->interests.isReadyForReading = false;
+    fileHandle->interests.isReadyForWriting = false;
+    fileHandle->interests.hasErrorConditionPending = false;
+    fileHandle->callback = NULL;
+    fileHandle->context = NULL;
+    fileHandle->nextFileHandle = NULL;
+    fileHandle->prevFileHandle = NULL;
+    FreePoolElement(&runLoop->fileHandlePool, fileHandle);
+}
+
+/**
+ * Returns whether the file handle dispatch budget of the current run loop iteration is exhausted.
+ *
+ * @param      runLoop              Run loop.
+ *
+ * @return true                     If the budget is exhausted.
+ * @return false                    If the budget is not exhausted or unlimited.
+ */
+HAP_RESULT_USE_CHECK
+static bool IsFileHandleDispatchBudgetExhausted(const HAPPlatformRunLoop* runLoop) {
+    HAPPrecondition(runLoop);
+
+    return runLoop->fileHandleDispatchBudget &&
+           HAPPlatformClockGetCurrentMicroseconds() >= runLoop->fileHandleDispatchDeadline;
+}
+
+static void ProcessPendingFileHandles(void) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    if (runLoop->fileHandleDispatchBudget) {
+        runLoop->fileHandleDispatchDeadline =
+                HAPPlatformClockGetCurrentMicroseconds() + runLoop->fileHandleDispatchBudget * 1000;
+    }
+
+    // File handles are removed from the list before their callback is invoked, so that reentrant registrations and
+    // deregistrations do not interfere. File handles registered by a callback are not in the list.
+    while (runLoop->pendingFileHandles) {
+        // Once the budget is exhausted, remaining file handles stay pending and are dispatched first in the next
+        // iteration, after timers and newly ready file handles have been collected without blocking.
+        if (IsFileHandleDispatchBudgetExhausted(runLoop)) {
+#if HAVE_RUN_LOOP_STATISTICS
+            runLoop->statistics.numDeferredFileHandleDispatches++;
+#endif
+            break;
+        }
+
+        HAPPlatformFileHandle* fileHandle = runLoop->pendingFileHandles;
+        HAPPlatformFileHandleEvent pendingEvents = fileHandle->pendingEvents;
+        RemovePendingFileHandle(fileHandle);
+
+        HAPAssert(fileHandle->fileDescriptor != -1);
+        if (fileHandle->callback) {
+            // Interests may have changed since the events were reported.
+            HAPPlatformFileHandleEvent fileHandleEvents;
+            fileHandleEvents.isReadyForReading =
+                    fileHandle->interests.isReadyForReading && pendingEvents.isReadyForReading;
+            fileHandleEvents.isReadyForWriting =
+                    fileHandle->interests.isReadyForWriting && pendingEvents.isReadyForWriting;
+            fileHandleEvents.hasErrorConditionPending =
+                    fileHandle->interests.hasErrorConditionPending && pendingEvents.hasErrorConditionPending;
+
+            if (fileHandleEvents.isReadyForReading || fileHandleEvents.isReadyForWriting ||
+                fileHandleEvents.hasErrorConditionPending) {
+#if HAVE_RUN_LOOP_WATCHDOG || HAVE_RUN_LOOP_STATISTICS
+                // The loopback callback dispatches scheduled callbacks, which are instrumented individually. A dispatch
+                // record around it would be cleared by the first scheduled callback and leave the rest unattributed,
+                // and its invocation time would count all scheduled callbacks a second time.
+                bool isInstrumented = (HAPPlatformFileHandleRef) fileHandle != runLoop->loopbackFileHandle;
+#endif
+#if HAVE_RUN_LOOP_WATCHDOG
+                if (isInstrumented) {
+                    BeginDispatch(
+                            kHAPPlatformRunLoopCallbackType_FileHandle,
+                            (const void*) (uintptr_t) fileHandle->callback);
+                }
+#endif
+#if HAVE_RUN_LOOP_STATISTICS
+                HAPPlatformFileHandleCallback callback = fileHandle->callback;
+                uint64_t startTime = HAPPlatformClockGetCurrentMicroseconds();
+#endif
+                fileHandle->callback((HAPPlatformFileHandleRef) fileHandle, fileHandleEvents, fileHandle->context);
+#if HAVE_RUN_LOOP_WATCHDOG
+                if (isInstrumented) {
+                    EndDispatch();
+                }
+#endif
+#if HAVE_RUN_LOOP_STATISTICS
+                if (isInstrumented) {
+                    RecordCallbackInvocation(
+                            kHAPPlatformRunLoopCallbackType_FileHandle,
+                            (const void*) (uintptr_t) callback,
+                            startTime);
+                }
+#endif
+            }
+        }
+    }
+}
+
+/**
+ * Number of low bits of a timer reference that encode the timer index.
+ *
+ * - Timer references encode the pool index of the timer (plus 1, so that references are non-zero) in the low bits and
+ *   the generation of the pool slot in the remaining high bits. Once a timer has expired or has been deregistered, the
+ *   slot generation changes, and the reference no longer resolves to a timer. Slots are retired once their generation
+ *   no longer fits into a reference, so references are never reused.
+ */
+#if UINTPTR_MAX > UINT32_MAX
+#define kHAPPlatformTimer_IndexBits 24
+#else
+#define kHAPPlatformTimer_IndexBits 14
+#endif
+
+/**
+ * Maximum number of timers that can be referenced.
+ */
+#define kHAPPlatformTimer_MaxTimers ((((size_t) 1) << kHAPPlatformTimer_IndexBits) - 1)
+
+/**
+ * Number of high bits of a timer reference that encode the generation of the pool slot.
+ */
+#define kHAPPlatformTimer_GenerationBits (sizeof(HAPPlatformTimerRef) * CHAR_BIT - kHAPPlatformTimer_IndexBits)
+
+/**
+ * Generation at which a timer pool slot is retired.
+ */
+#define kHAPPlatformTimer_MaxGeneration \
+    ((uint32_t) HAPMin((((uint64_t) 1) << kHAPPlatformTimer_GenerationBits) - 1, (uint64_t) UINT32_MAX))
+
+/**
+ * Resolves a timer reference.
+ *
+ * @param      timer                Timer reference.
+ *
+ * @return Timer, if the timer has not yet been deregistered or freed after expiring. NULL otherwise.
+ */
+HAP_RESULT_USE_CHECK
+static HAPPlatformTimer* _Nullable GetTimer(HAPPlatformTimerRef timer) {
+    HAPPrecondition(timer);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    size_t index = (size_t)(timer & kHAPPlatformTimer_MaxTimers);
+    HAPPrecondition(index);
+    index--;
+    HAPPrecondition(index < runLoop->timerPool.statistics.capacity);
+
+    HAPPlatformTimerRef generation = timer >> kHAPPlatformTimer_IndexBits;
+    HAPPlatformTimer* timerObject = GetPoolElement(&runLoop->timerPool, index);
+    if (GetPoolElementGeneration(timerObject) != generation) {
+        return NULL;
+    }
+    return timerObject;
+}
+
+/**
+ * Returns whether a timer fires before another timer.
+ *
+ * - Timers are ordered by the latest time at which they may fire, so that the run loop only needs to wake up for the
+ *   timer at the top of the heap. Timers with the same latest deadline fire in order of registration.
+ *
+ * @param      timer                Timer.
+ * @param      otherTimer           Other timer.
+ *
+ * @return true                     If the timer fires before the other timer.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+static bool IsTimerBefore(const HAPPlatformTimer* timer, const HAPPlatformTimer* otherTimer) {
+    HAPPrecondition(timer);
+    HAPPrecondition(otherTimer);
+
+    if (timer->latestDeadline != otherTimer->latestDeadline) {
+        return timer->latestDeadline < otherTimer->latestDeadline;
+    }
+    return timer->sequenceNumber < otherTimer->sequenceNumber;
+}
+
+/**
+ * Stores a timer at a given index of the timer heap.
+ *
+ * @param      index                Index in the timer heap.
+ * @param      timer                Timer.
+ */
+static void SetTimerHeapElement(size_t index, HAPPlatformTimer* timer) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPrecondition(index < runLoop->numTimers);
+    HAPPrecondition(timer);
+
+    runLoop->timers[index] = timer;
+    timer->heapIndex = index;
+}
+
+/**
+ * Moves a timer towards the root of the timer heap until the heap property is restored.
+ *
+ * @param      index                Index of the timer in the timer heap.
+ */
+static void SiftTimerUp(size_t index) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPrecondition(index < runLoop->numTimers);
+
+    HAPPlatformTimer* timer = runLoop->timers[index];
+    HAPAssert(timer);
+    while (index) {
+        size_t parentIndex = (index - 1) / 2;
+        HAPPlatformTimer* parentTimer = runLoop->timers[parentIndex];
+        HAPAssert(parentTimer);
+        if (!IsTimerBefore(timer, parentTimer)) {
+            break;
+        }
+        SetTimerHeapElement(index, parentTimer);
+        index = parentIndex;
+    }
+    SetTimerHeapElement(index, timer);
+}
+
+/**
+ * Moves a timer towards the leaves of the timer heap until the heap property is restored.
+ *
+ * @param      index                Index of the timer in the timer heap.
+ */
+static void SiftTimerDown(size_t index) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPrecondition(index < runLoop->numTimers);
+
+    HAPPlatformTimer* timer = runLoop->timers[index];
+    HAPAssert(timer);
+    for (;;) {
+        size_t childIndex = 2 * index + 1;
+        if (childIndex >= runLoop->numTimers) {
+            break;
+        }
+        if (childIndex + 1 < runLoop->numTimers &&
+            IsTimerBefore(HAPNonnull(runLoop->timers[childIndex + 1]), HAPNonnull(runLoop->timers[childIndex]))) {
+            childIndex++;
+        }
+        HAPPlatformTimer* childTimer = runLoop->timers[childIndex];
+        HAPAssert(childTimer);
+        if (!IsTimerBefore(childTimer, timer)) {
+            break;
+        }
+        SetTimerHeapElement(index, childTimer);
+        index = childIndex;
+    }
+    SetTimerHeapElement(index, timer);
+}
+
+/**
+ * Removes a timer from the timer heap.
+ *
+ * @param      timer                Timer.
+ */
+static void RemoveTimer(HAPPlatformTimer* timer) {
+    HAPPrecondition(timer);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPrecondition(timer->heapIndex < runLoop->numTimers);
+    HAPPrecondition(runLoop->timers[timer->heapIndex] == timer);
+
+    size_t index = timer->heapIndex;
+    runLoop->numTimers--;
+    if (index != runLoop->numTimers) {
+        HAPPlatformTimer* lastTimer = runLoop->timers[runLoop->numTimers];
+        HAPAssert(lastTimer);
+        SetTimerHeapElement(index, lastTimer);
+        if (index && IsTimerBefore(lastTimer, HAPNonnull(runLoop->timers[(index - 1) / 2]))) {
+            SiftTimerUp(index);
+        } else {
+            SiftTimerDown(index);
+        }
+    }
+    runLoop->timers[runLoop->numTimers] = NULL;
+    timer->heapIndex = SIZE_MAX;
+}
+
+/**
+ * Inserts a timer into the timer heap.
+ *
+ * - The timer heap has room for every allocated timer.
+ *
+ * @param      timer                Timer with deadline and tolerance set.
+ */
+static void InsertTimer(HAPPlatformTimer* timer) {
+    HAPPrecondition(timer);
+    HAPPrecondition(timer->deadline);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPrecondition(runLoop->numTimers < runLoop->maxTimers);
+
+    timer->latestDeadline = UINT64_MAX;
+    if (timer->deadline <= UINT64_MAX - timer->tolerance) {
+        timer->latestDeadline = timer->deadline + timer->tolerance;
+    }
+    timer->sequenceNumber = runLoop->nextTimerSequenceNumber++;
+
+    runLoop->numTimers++;
+    SetTimerHeapElement(runLoop->numTimers - 1, timer);
+    SiftTimerUp(runLoop->numTimers - 1);
+}
+
+/**
+ * Registers a timer.
+ *
+ * @param[out] timer                Non-zero Timer object reference, if successful.
+ * @param      deadline             Deadline after which the timer expires.
+ * @param      tolerance            Time in milliseconds by which the timer may be fired after its deadline.
+ * @param      period               Period after which the timer is re-armed. 0 for one-shot timers.
+ * @param      callback             Function to call when the timer expires.
+ * @param      context              Context that is passed to the callback.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If no more timers can be allocated.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError RegisterTimer(
+        HAPPlatformTimerRef* timer,
+        HAPTime deadline,
+        HAPTime tolerance,
+        HAPTime period,
+        HAPPlatformTimerCallback callback,
+        void* _Nullable context) {
+    HAPPrecondition(timer);
+    HAPPrecondition(callback);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    *timer = 0;
+
+    // The timer pool does not grow beyond the number of timers that can be referenced.
+    if (runLoop->timerPool.statistics.numElements >= kHAPPlatformTimer_MaxTimers) {
+        HAPLog(&logObject, "Cannot reference more timers.");
+        return kHAPError_OutOfResources;
+    }
+
+    // Grow timer heap so that it has room for every allocated timer. This allows re-arming periodic timers in place.
+    if (runLoop->timerPool.statistics.numElements >= runLoop->maxTimers) {
+        size_t maxTimers = HAPMin(runLoop->maxTimers ? 2 * runLoop->maxTimers : 16, kHAPPlatformTimer_MaxTimers);
+        HAPPlatformTimer* _Nullable* timers = realloc(runLoop->timers, maxTimers * sizeof *timers);
+        if (!timers) {
+            HAPLog(&logObject, "Cannot grow timer heap.");
+            return kHAPError_OutOfResources;
+        }
+        runLoop->timers = timers;
+        runLoop->maxTimers = maxTimers;
+    }
+    HAPAssert(runLoop->timerPool.statistics.numElements < runLoop->maxTimers);
+
+    // Prepare timer.
+    HAPPlatformTimer* _Nullable newTimer = AllocatePoolElement(&runLoop->timerPool);
+    if (!newTimer) {
+        HAPLog(&logObject, "Cannot allocate more timers.");
+        return kHAPError_OutOfResources;
+    }
+    size_t index = GetPoolElementIndex(&runLoop->timerPool, newTimer);
+    HAPAssert(index < kHAPPlatformTimer_MaxTimers);
+    HAPPlatformTimerRef generation = GetPoolElementGeneration(newTimer);
+    HAPAssert(generation < kHAPPlatformTimer_MaxGeneration);
+    newTimer->ref =
+            ((HAPPlatformTimerRef) generation << kHAPPlatformTimer_IndexBits) | (HAPPlatformTimerRef)(index + 1);
+    newTimer->deadline = deadline ? deadline : 1;
+    newTimer->tolerance = tolerance;
+    newTimer->period = period;
+    newTimer->callback = callback;
+    newTimer->context = context;
+
+    // Insert timer.
+    InsertTimer(newTimer);
+
+    *timer = newTimer->ref;
+    return kHAPError_None;
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTimerRegister(
+        HAPPlatformTimerRef* timer,
+        HAPTime deadline,
+        HAPPlatformTimerCallback callback,
+        void* _Nullable context) {
+    return RegisterTimer(timer, deadline, /* tolerance: */ 0, /* period: */ 0, callback, context);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTimerRegisterWithTolerance(
+        HAPPlatformTimerRef* timer,
+        HAPTime deadline,
+        HAPTime tolerance,
+        HAPPlatformTimerCallback callback,
+        void* _Nullable context) {
+    return RegisterTimer(timer, deadline, tolerance, /* period: */ 0, callback, context);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTimerRegisterPeriodic(
+        HAPPlatformTimerRef* timer,
+        HAPTime deadline,
+        HAPTime period,
+        HAPPlatformTimerCallback callback,
+        void* _Nullable context) {
+    HAPPrecondition(period);
+
+    return RegisterTimer(timer, deadline, /* tolerance: */ 0, period, callback, context);
+}
+
+void HAPPlatformTimerSetPeriod(HAPPlatformTimerRef timer_, HAPTime period) {
+    HAPPrecondition(timer_);
+
+    HAPPlatformTimer* _Nullable timer = GetTimer(timer_);
+    if (!timer || timer->isDeregistered) {
+        HAPLogDebug(&logObject, "Ignoring period change of expired timer 0x%lx.", (unsigned long) timer_);
+        return;
+    }
+    timer->period = period;
+}
+
+void HAPPlatformTimerDeregister(HAPPlatformTimerRef timer_) {
+    HAPPrecondition(timer_);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    // Deregistering a timer that has already expired is a no-op.
+    HAPPlatformTimer* _Nullable timer = GetTimer(timer_);
+    if (!timer) {
+        HAPLogDebug(&logObject, "Ignoring deregistration of expired timer 0x%lx.", (unsigned long) timer_);
+        return;
+    }
+
+    // Timer is expiring, i.e., its callback is being invoked. It is freed once the callback returns.
+    if (timer->heapIndex >= runLoop->numTimers || runLoop->timers[timer->heapIndex] != timer) {
+        timer->isDeregistered = true;
+        return;
+    }
+
+    RemoveTimer(timer);
+    FreePoolElement(&runLoop->timerPool, timer);
+}
+
+/**
+ * Invokes the callbacks of expired timers.
+ *
+ * @param      isWakeupCausedByEvents Whether the run loop has been woken up by I/O or has not blocked at all.
+ */
+static void ProcessExpiredTimers(bool isWakeupCausedByEvents) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    // Get time of the current run loop iteration.
+    HAPTime now = HAPPlatformClockGetLoopTime();
+
+    // Enumerate timers.
+    // The run loop wakes up for the latest deadline of the first timer. Any timers whose tolerance window has been
+    // entered by then are fired in the same pass, so that they do not require a wakeup of their own.
+    // Timers whose latest deadline has passed are always reached, as their deadline cannot be later than it.
+#if HAVE_RUN_LOOP_STATISTICS
+    // A timer that fires before its latest deadline only saves a wakeup if the run loop has been woken up for another
+    // reason, i.e., by a timer whose latest deadline has passed or by events. Otherwise, the first such timer accounts
+    // for the wakeup itself. Timers with the same deadline would have shared a wakeup in any case.
+    bool isWakeupAccountedFor = isWakeupCausedByEvents ||
+                                (runLoop->numTimers && HAPNonnull(runLoop->timers[0])->latestDeadline <= now);
+    HAPTime lastDeadline = 0;
+#else
+    (void) isWakeupCausedByEvents;
+#endif
+    while (runLoop->numTimers) {
+        HAPPlatformTimer* expiredTimer = runLoop->timers[0];
+        HAPAssert(expiredTimer);
+        if (expiredTimer->deadline > now) {
+            break;
+        }
+#if HAVE_RUN_LOOP_STATISTICS
+        if (expiredTimer->latestDeadline > now && expiredTimer->deadline != lastDeadline) {
+            if (isWakeupAccountedFor) {
+                runLoop->statistics.numSavedTimerWakeups++;
+            }
+            isWakeupAccountedFor = true;
+        }
+        lastDeadline = expiredTimer->deadline;
+#endif
+
+        // Remove timer first, so that reentrant add / removes do not interfere.
+        RemoveTimer(expiredTimer);
+
+        // Invoke callback.
+#if HAVE_RUN_LOOP_STATISTICS
+        // Deadlines have millisecond resolution, and HAPPlatformClockGetCurrent is not based on the microsecond clock,
+        // so lateness is recorded in milliseconds. The clock is read again because earlier callbacks of this pass may
+        // have delayed the timer beyond the cached loop time.
+        HAPTime currentTime = HAPPlatformClockGetCurrent();
+        RecordHistogramValue(
+                &runLoop->statistics.timerLateness,
+                currentTime > expiredTimer->deadline ? currentTime - expiredTimer->deadline : 0);
+        uint64_t startTime = HAPPlatformClockGetCurrentMicroseconds();
+#endif
+#if HAVE_RUN_LOOP_WATCHDOG
+        BeginDispatch(kHAPPlatformRunLoopCallbackType_Timer, (const void*) (uintptr_t) expiredTimer->callback);
+#endif
+        expiredTimer->callback(expiredTimer->ref, expiredTimer->context);
+#if HAVE_RUN_LOOP_WATCHDOG
+        EndDispatch();
+#endif
+#if HAVE_RUN_LOOP_STATISTICS
+        RecordCallbackInvocation(
+                kHAPPlatformRunLoopCallbackType_Timer, (const void*) (uintptr_t) expiredTimer->callback, startTime);
+#endif
+
+        // Re-arm periodic timers in place at a fixed rate. Expirations that have been missed entirely are skipped.
+        if (expiredTimer->period && !expiredTimer->isDeregistered) {
+            HAPTime period = expiredTimer->period;
+            HAPTime deadline = expiredTimer->deadline + period;
+            if (deadline <= now) {
+                deadline += ((now - deadline) / period + 1) * period;
+            }
+            expiredTimer->deadline = deadline;
+            InsertTimer(expiredTimer);
+            continue;
+        }
+
+        // Free memory.
+        FreePoolElement(&runLoop->timerPool, expiredTimer);
+    }
+}
+
+void HAPPlatformRunLoopRegisterIdleTask(
+        HAPPlatformRunLoopIdleTask* idleTask,
+        HAPPlatformRunLoopIdleTaskCallback callback,
+        void* _Nullable context) {
+    HAPPrecondition(idleTask);
+    HAPPrecondition(!idleTask->callback);
+    HAPPrecondition(callback);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    idleTask->callback = callback;
+    idleTask->context = context;
+    idleTask->hasWork = true;
+    idleTask->prevIdleTask = NULL;
+    idleTask->nextIdleTask = runLoop->idleTasks;
+    if (runLoop->idleTasks) {
+        HAPNonnull(runLoop->idleTasks)->prevIdleTask = idleTask;
+    }
+    runLoop->idleTasks = idleTask;
+    runLoop->numPendingIdleTasks++;
+}
+
+void HAPPlatformRunLoopDeregisterIdleTask(HAPPlatformRunLoopIdleTask* idleTask) {
+    HAPPrecondition(idleTask);
+    HAPPrecondition(idleTask->callback);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    if (idleTask->prevIdleTask) {
+        HAPNonnull(idleTask->prevIdleTask)->nextIdleTask = idleTask->nextIdleTask;
+    } else {
+        HAPAssert(runLoop->idleTasks == idleTask);
+        runLoop->idleTasks = idleTask->nextIdleTask;
+    }
+    if (idleTask->nextIdleTask) {
+        HAPNonnull(idleTask->nextIdleTask)->prevIdleTask = idleTask->prevIdleTask;
+    }
+    if (runLoop->nextIdleTask == idleTask) {
+        runLoop->nextIdleTask = idleTask->nextIdleTask;
+    }
+    if (idleTask->hasWork) {
+        HAPAssert(runLoop->numPendingIdleTasks);
+        runLoop->numPendingIdleTasks--;
+    }
+
+    idleTask->callback = NULL;
+    idleTask->context = NULL;
+    idleTask->prevIdleTask = NULL;
+    idleTask->nextIdleTask = NULL;
+    idleTask->hasWork = false;
+}
+
+void HAPPlatformRunLoopSignalIdleTask(HAPPlatformRunLoopIdleTask* idleTask) {
+    HAPPrecondition(idleTask);
+    HAPPrecondition(idleTask->callback);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    if (!idleTask->hasWork) {
+        idleTask->hasWork = true;
+        runLoop->numPendingIdleTasks++;
+    }
+}
+
+/**
+ * Returns whether idle tasks may run, i.e., whether idle tasks have pending work and no timer is due within the idle
+ * task margin.
+ *
+ * @return true                     If idle tasks may run.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+static bool MayProcessIdleTasks(void) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    if (!runLoop->numPendingIdleTasks) {
+        return false;
+    }
+    if (runLoop->numTimers) {
+        HAPTime nextDeadline = HAPNonnull(runLoop->timers[0])->latestDeadline;
+        if (nextDeadline < HAPPlatformClockGetCurrent() + runLoop->idleTaskMargin) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Invokes idle tasks with pending work round-robin until the idle task budget is exhausted.
+ */
+static void ProcessIdleTasks(void) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    uint64_t startTime = HAPPlatformClockGetCurrentMicroseconds();
+    while (runLoop->numPendingIdleTasks && runLoop->state == kHAPPlatformRunLoopState_Running) {
+        HAPPlatformRunLoopIdleTask* idleTask =
+                HAPNonnull(runLoop->nextIdleTask ? runLoop->nextIdleTask : runLoop->idleTasks);
+        runLoop->nextIdleTask = idleTask->nextIdleTask;
+        if (!idleTask->hasWork) {
+            continue;
+        }
+
+        HAPPlatformRunLoopIdleTaskCallback callback = HAPNonnull(idleTask->callback);
+#if HAVE_RUN_LOOP_STATISTICS
+        uint64_t callbackStartTime = HAPPlatformClockGetCurrentMicroseconds();
+#endif
+#if HAVE_RUN_LOOP_WATCHDOG
+        BeginDispatch(kHAPPlatformRunLoopCallbackType_Idle, (const void*) (uintptr_t) callback);
+#endif
+        bool hasWork = callback(idleTask, idleTask->context);
+#if HAVE_RUN_LOOP_WATCHDOG
+        EndDispatch();
+#endif
+#if HAVE_RUN_LOOP_STATISTICS
+        RecordCallbackInvocation(
+                kHAPPlatformRunLoopCallbackType_Idle, (const void*) (uintptr_t) callback, callbackStartTime);
+#endif
+
+        // The idle task may have been deregistered by its callback.
+        if (idleTask->callback && idleTask->hasWork && !hasWork) {
+            idleTask->hasWork = false;
+            HAPAssert(runLoop->numPendingIdleTasks);
+            runLoop->numPendingIdleTasks--;
+        }
+
+        if (HAPPlatformClockGetCurrentMicroseconds() - startTime >= runLoop->idleTaskBudget * 1000) {
+            break;
+        }
+    }
+}
+
+void CloseLoopback(int fileDescriptor)
+{
+    if (fileDescriptor != -1) {
+        HAPLogDebug(&logObject, "close(%d);", fileDescriptor);
+        int e = close(fileDescriptor);
+        if (e != 0) {
+            int _errno = errno;
+            HAPAssert(e == -1);
+            HAPPlatformLogPOSIXError(kHAPLogType_Error, "Closing loopback failed (log, fileDescriptor0).",
+                _errno, __func__, HAP_FILE, __LINE__);
+        }
+    }
+}
+
+/**
+ * Sends a wakeup on the loopback unless one is already pending.
+ *
+ * @param      runLoop              Run loop to wake.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the wakeup could not be sent. Callbacks that have already been published are
+ *                                  invoked after the next successful wakeup.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError SignalLoopback(HAPPlatformRunLoop* runLoop) {
+    HAPPrecondition(runLoop);
+
+    // Make the published queue slots visible before checking whether a wakeup is pending.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&runLoop->isWakeupPending, 1, __ATOMIC_SEQ_CST)) {
+        return kHAPError_None;
+    }
+
+    uint8_t byte = 0;
+    ssize_t n;
+    do {
+        n = send(runLoop->loopbackSendFileDescriptor, &byte, sizeof byte, 0);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1) {
+        int _errno = errno;
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+            "Loopback failed to send wakeup (log, call 'send').",
+            _errno, __func__, HAP_FILE, __LINE__);
+
+        // Let the next producer retry. Queued callbacks are dispatched on the next wakeup.
+        __atomic_store_n(&runLoop->isWakeupPending, 0, __ATOMIC_SEQ_CST);
+        return kHAPError_Unknown;
+    }
+    return kHAPError_None;
+}
+
+/**
+ * Returns whether a queued callback is superseded by a callback with the same coalescing key that has been published
+ * after it in the same queue.
+ *
+ * @param      queue                Scheduled callback queue.
+ * @param      position             Dequeue position of the callback.
+ * @param      coalescingKey        Coalescing key of the callback.
+ *
+ * @return true                     If the callback is superseded.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+static bool IsScheduledCallbackSuperseded(
+        const HAPPlatformRunLoopCallbackQueue* queue,
+        uint32_t position,
+        uint32_t coalescingKey) {
+    HAPPrecondition(queue);
+    HAPPrecondition(coalescingKey);
+
+    for (uint32_t i = 1; i < queue->numSlots; i++) {
+        const HAPPlatformRunLoopScheduledCallback* scheduledCallback =
+                &HAPNonnull(queue->slots)[(position + i) & (queue->numSlots - 1)];
+        if (__atomic_load_n(&scheduledCallback->sequenceNumber, __ATOMIC_ACQUIRE) != position + i + 1) {
+            break;
+        }
+        if (scheduledCallback->coalescingKey == coalescingKey) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    // Enumerate timers.
-    while (runLoop.timers) {
-        if (runLoop.timers->deadline > now) {
-            break;
+/**
+ * Invokes the next published callback of a scheduled callback queue.
+ *
+ * - The callback is invoked in place. The queue slot is released after the callback returns.
+ *
+ * - A callback with a coalescing key is skipped if a newer callback with the same key is already queued.
+ *
+ * @param      queue                Scheduled callback queue.
+ *
+ * @return true                     If a callback has been dequeued.
+ * @return false                    If the queue is empty.
+ */
+HAP_RESULT_USE_CHECK
+static bool ProcessNextScheduledCallback(HAPPlatformRunLoopCallbackQueue* queue) {
+    HAPPrecondition(queue);
+
+    uint32_t position = queue->dequeuePosition;
+    HAPPlatformRunLoopScheduledCallback* scheduledCallback =
+            &HAPNonnull(queue->slots)[position & (queue->numSlots - 1)];
+    uint32_t sequenceNumber = __atomic_load_n(&scheduledCallback->sequenceNumber, __ATOMIC_ACQUIRE);
+    if (sequenceNumber != position + 1) {
+        // Queue is empty or the next callback is still being written by its producer.
+        return false;
+    }
+
+    HAPPlatformRunLoopCallback callback = scheduledCallback->callback;
+    HAPAssert(callback);
+    if (scheduledCallback->coalescingKey &&
+        IsScheduledCallbackSuperseded(queue, position, scheduledCallback->coalescingKey)) {
+#if HAVE_RUN_LOOP_STATISTICS
+        GetCurrentRunLoop()->statistics.numCoalescedCallbacks++;
+#endif
+    } else {
+#if HAVE_RUN_LOOP_STATISTICS
+        uint64_t startTime = HAPPlatformClockGetCurrentMicroseconds();
+#endif
+#if HAVE_RUN_LOOP_WATCHDOG
+        BeginDispatch(kHAPPlatformRunLoopCallbackType_Scheduled, (const void*) (uintptr_t) callback);
+#endif
+        if (scheduledCallback->contextReference) {
+            callback(scheduledCallback->contextReference, scheduledCallback->contextSize);
+        } else {
+            callback(scheduledCallback->contextSize ? scheduledCallback->context : NULL,
+                     scheduledCallback->contextSize);
         }
+#if HAVE_RUN_LOOP_WATCHDOG
+        EndDispatch();
+#endif
+#if HAVE_RUN_LOOP_STATISTICS
+        RecordCallbackInvocation(
+                kHAPPlatformRunLoopCallbackType_Scheduled, (const void*) (uintptr_t) callback, startTime);
+#endif
+    }
 
-        // Update head, so that reentrant add / removes do not interfere.
-        HAPPlatformTimer* expiredTimer = runLoop.timers;
-        runLoop.timers = runLoop.timers->nextTimer;
+    scheduledCallback->callback = NULL;
+    scheduledCallback->contextReference = NULL;
+    scheduledCallback->coalescingKey = 0;
+    __atomic_store_n(&scheduledCallback->sequenceNumber, position + queue->numSlots, __ATOMIC_RELEASE);
+    queue->dequeuePosition = position + 1;
+    return true;
+}
 
-        // Invoke callback.
-        expiredTimer->callback((HAPPlatformTimerRef) expiredTimer, expiredTimer->context);
+/**
+ * Returns whether the next callback of a scheduled callback queue has been published.
+ *
+ * @param      queue                Scheduled callback queue.
+ *
+ * @return true                     If the next callback has been published.
+ * @return false                    If the queue is empty or the next callback is still being written by its producer.
+ */
+HAP_RESULT_USE_CHECK
+static bool IsScheduledCallbackPublished(const HAPPlatformRunLoopCallbackQueue* queue) {
+    HAPPrecondition(queue);
 
-        // Free memory.
-        HAPPlatformFreeSafe(expiredTimer);
-    }
+    uint32_t position = queue->dequeuePosition;
+    const HAPPlatformRunLoopScheduledCallback* scheduledCallback =
+            &HAPNonnull(queue->slots)[position & (queue->numSlots - 1)];
+    return __atomic_load_n(&scheduledCallback->sequenceNumber, __ATOMIC_ACQUIRE) == position + 1;
 }
 
-void CloseLoopback(int fileDescriptor)
-{
-    if (fileDescriptor != -1) {
-        HAPLogDebug(&logObject, "close(%d);", fileDescriptor);
-        int e = close(fileDescriptor);
-        if (e != 0) {
-            int _errno = errno;
-            HAPAssert(e == -1);
-            HAPPlatformLogPOSIXError(kHAPLogType_Error, "Closing loopback failed (log, fileDescriptor0).",
-                _errno, __func__, HAP_FILE, __LINE__);
+/**
+ * Invokes the callbacks that have been published to the scheduled callback queues when the drain starts.
+ *
+ * - The urgent queue is drained first. It is checked again before each callback of the normal queue.
+ *
+ * - Callbacks that are published while the queues are drained, e.g., by a callback that reschedules itself or by a
+ *   producer task that keeps publishing, are left for the next run loop iteration, so that they cannot starve timers
+ *   and file handles.
+ *
+ * - Once the file handle dispatch budget is exhausted, remaining callbacks are left for the next run loop iteration.
+ */
+static void ProcessScheduledCallbacks(void) {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPlatformRunLoopCallbackQueue* urgentQueue = &runLoop->callbackQueues[kHAPPlatformRunLoopCallbackPriority_Urgent];
+    HAPPlatformRunLoopCallbackQueue* normalQueue = &runLoop->callbackQueues[kHAPPlatformRunLoopCallbackPriority_Normal];
+    uint32_t urgentEndPosition = __atomic_load_n(&urgentQueue->enqueuePosition, __ATOMIC_RELAXED);
+    uint32_t normalEndPosition = __atomic_load_n(&normalQueue->enqueuePosition, __ATOMIC_RELAXED);
+#if HAVE_RUN_LOOP_STATISTICS
+    RecordHistogramValue(
+            &runLoop->statistics.scheduledCallbackQueueDepth,
+            (urgentEndPosition - urgentQueue->dequeuePosition) + (normalEndPosition - normalQueue->dequeuePosition));
+#endif
+    bool isBudgetExhausted = false;
+    for (;;) {
+        if (!(urgentQueue->dequeuePosition != urgentEndPosition && ProcessNextScheduledCallback(urgentQueue)) &&
+            !(normalQueue->dequeuePosition != normalEndPosition && ProcessNextScheduledCallback(normalQueue))) {
+            break;
+        }
+
+        // The budget is shared with file handle callbacks. It is checked after each callback, so that at least one
+        // callback is invoked per drain even if file handle callbacks have already exhausted it.
+        if (IsFileHandleDispatchBudgetExhausted(runLoop)) {
+            isBudgetExhausted = true;
+            break;
+        }
+    }
+
+    // Callbacks that are still being written by their producer are followed by a wakeup from that producer.
+    // Published callbacks that have been left for the next iteration need a wakeup of their own.
+    if (IsScheduledCallbackPublished(urgentQueue) || IsScheduledCallbackPublished(normalQueue)) {
+#if HAVE_RUN_LOOP_STATISTICS
+        if (isBudgetExhausted) {
+            runLoop->statistics.numDeferredScheduledCallbackDispatches++;
+        }
+#else
+        (void) isBudgetExhausted;
+#endif
+        HAPError err = SignalLoopback(runLoop);
+        if (err) {
+            HAPAssert(err == kHAPError_Unknown);
+            HAPLogError(&logObject, "Remaining scheduled callbacks are invoked after the next wakeup.");
         }
     }
 }
@@ -404,83 +2899,50 @@ static void HandleLoopbackFileHandleCallback(
     HAPPlatformFileHandleEvent fileHandleEvents,
     void *_Nullable context HAP_UNUSED)
 {
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
     HAPAssert(fileHandle);
-    HAPAssert(fileHandle == runLoop.loopbackFileHandle);
+    HAPAssert(fileHandle == runLoop->loopbackFileHandle);
     HAPAssert(fileHandleEvents.isReadyForReading);
 
-    HAPAssert(runLoop.numLoopbackBytes < sizeof runLoop.loopbackBytes);
-    
-    ssize_t n;
-    do {
-        n = recvfrom(runLoop.loopbackFileDescriptor,
-                &runLoop.loopbackBytes[runLoop.numLoopbackBytes],
-                sizeof runLoop.loopbackBytes - runLoop.numLoopbackBytes, 0, NULL, NULL);
-    } while (n == -1 && errno == EINTR);
-    if (n == -1 && errno == EAGAIN) {
-        return;
-    }
-
-    if (n < 0) {
-        int _errno = errno;
-        HAPAssert(n == -1);
-        HAPPlatformLogPOSIXError(kHAPLogType_Error,
-            "Loopback read failed.", _errno, __func__, HAP_FILE, __LINE__);
-        HAPFatalError();
-    }
-    if (n == 0) {
-        HAPLogError(&logObject, "Loopback socket read returned no data.");
-        HAPFatalError();
-    }
-
-    HAPAssert((size_t) n <= sizeof runLoop.loopbackBytes - runLoop.numLoopbackBytes);
-    runLoop.numLoopbackBytes += (size_t) n;
+    // Drain wakeups. Their content is irrelevant.
     for (;;) {
-        if (runLoop.numLoopbackBytes < sizeof (HAPPlatformRunLoopCallback) + 1) {
+        uint8_t bytes[16];
+        ssize_t n;
+        do {
+            n = recv(runLoop->loopbackFileDescriptor, bytes, sizeof bytes, 0);
+        } while (n == -1 && errno == EINTR);
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
             break;
         }
-        size_t contextSize = (size_t) runLoop.loopbackBytes[sizeof (HAPPlatformRunLoopCallback)];
-        if (runLoop.numLoopbackBytes < sizeof (HAPPlatformRunLoopCallback) + 1 + contextSize) {
-            break;
+        if (n < 0) {
+            int _errno = errno;
+            HAPAssert(n == -1);
+            HAPPlatformLogPOSIXError(kHAPLogType_Error,
+                "Loopback read failed.", _errno, __func__, HAP_FILE, __LINE__);
+            HAPFatalError();
+        }
+        if (n == 0) {
+            HAPLogError(&logObject, "Loopback socket read returned no data.");
+            HAPFatalError();
         }
-
-        HAPPlatformRunLoopCallback callback;
-        HAPRawBufferCopyBytes(
-            &callback,
-            &runLoop.loopbackBytes[0],
-            sizeof (HAPPlatformRunLoopCallback));
-        HAPRawBufferCopyBytes(
-            &runLoop.loopbackBytes[0],
-            &runLoop.loopbackBytes[sizeof (HAPPlatformRunLoopCallback) + 1],
-            runLoop.numLoopbackBytes - (sizeof (HAPPlatformRunLoopCallback) + 1));
-        runLoop.numLoopbackBytes -= (sizeof (HAPPlatformRunLoopCallback) + 1);
-
-        // Issue memory barrier to ensure visibility of data referenced by callback context.
-        __sync_synchronize();
-
-        callback(
-            contextSize ? &runLoop.loopbackBytes[0] : NULL,
-            contextSize);
-
-        HAPRawBufferCopyBytes(
-            &runLoop.loopbackBytes[0],
-            &runLoop.loopbackBytes[contextSize],
-            runLoop.numLoopbackBytes - contextSize);
-        runLoop.numLoopbackBytes -= contextSize;
     }
-}
-
-void HAPPlatformRunLoopCreate(const HAPPlatformRunLoopOptions* options) {
-    HAPPrecondition(options);
-    HAPPrecondition(options->keyValueStore);
-    HAPError err;
 
-    HAPLogDebug(&logObject, "Storage configuration: runLoop = %lu", (unsigned long) sizeof runLoop);
-    HAPLogDebug(&logObject, "Storage configuration: fileHandle = %lu", (unsigned long) sizeof(HAPPlatformFileHandle));
-    HAPLogDebug(&logObject, "Storage configuration: timer = %lu", (unsigned long) sizeof(HAPPlatformTimer));
+    // Clear the pending wakeup before draining the queue, so that callbacks that are published after the queue
+    // has been found empty send a new wakeup.
+    __atomic_store_n(&runLoop->isWakeupPending, 0, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
 
-    // Open loop back
+    ProcessScheduledCallbacks();
+}
 
-    HAPPrecondition(runLoop.loopbackFileDescriptor == -1);
+/**
+ * Opens a non-blocking UDP socket for the loopback.
+ *
+ * @return File descriptor of the socket.
+ */
+HAP_RESULT_USE_CHECK
+static int OpenLoopbackSocket(void) {
     int fileDescriptor = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     if (fileDescriptor < 0) {
         int _errno = errno;
@@ -492,15 +2954,92 @@ void HAPPlatformRunLoopCreate(const HAPPlatformRunLoopOptions* options) {
     int e = fcntl(fileDescriptor, F_SETFL, O_NONBLOCK);
     if (e == -1) {
         HAPPlatformLogPOSIXError(kHAPLogType_Error,
-            "System call 'fcntl' to set loopback recv file descriptor flags to 'non-blocking' failed.",
+            "System call 'fcntl' to set loopback file descriptor flags to 'non-blocking' failed.",
             errno, __func__, HAP_FILE, __LINE__);
         HAPFatalError();
     }
+    return fileDescriptor;
+}
+
+void HAPPlatformRunLoopCreate(const HAPPlatformRunLoopOptions* options) {
+    HAPPrecondition(options);
+    HAPPrecondition(options->keyValueStore);
+
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPError err;
+
+    HAPLogDebug(&logObject, "Storage configuration: runLoop = %lu", (unsigned long) sizeof *runLoop);
+    HAPLogDebug(&logObject, "Storage configuration: fileHandle = %lu", (unsigned long) sizeof(HAPPlatformFileHandle));
+    HAPLogDebug(&logObject, "Storage configuration: timer = %lu", (unsigned long) sizeof(HAPPlatformTimer));
+
+    // Prepare object pools.
+    size_t numFileHandles =
+            options->numFileHandles ? options->numFileHandles : kHAPPlatformRunLoop_DefaultNumFileHandles;
+    size_t numTimers = options->numTimers ? options->numTimers : kHAPPlatformRunLoop_DefaultNumTimers;
+    HAPLogDebug(&logObject, "Storage configuration: numFileHandles = %lu", (unsigned long) numFileHandles);
+    HAPLogDebug(&logObject, "Storage configuration: numTimers = %lu", (unsigned long) numTimers);
+    CreatePool(
+            &runLoop->fileHandlePool,
+            sizeof(HAPPlatformFileHandle),
+            numFileHandles,
+            /* maxCapacity: */ UINT32_MAX,
+            /* maxGeneration: */ UINT32_MAX,
+            /* allowsHeapOverflow: */ !options->disallowsHeapOverflow);
+    CreatePool(
+            &runLoop->timerPool,
+            sizeof(HAPPlatformTimer),
+            numTimers,
+            /* maxCapacity: */ kHAPPlatformTimer_MaxTimers,
+            kHAPPlatformTimer_MaxGeneration,
+            /* allowsHeapOverflow: */ !options->disallowsHeapOverflow);
+
+    // Prepare scheduled callback queue.
+    runLoop->callbackQueues[kHAPPlatformRunLoopCallbackPriority_Normal].slots = runLoop->scheduledCallbacks;
+    runLoop->callbackQueues[kHAPPlatformRunLoopCallbackPriority_Normal].numSlots =
+            kHAPPlatformRunLoop_NumScheduledCallbacks;
+    runLoop->callbackQueues[kHAPPlatformRunLoopCallbackPriority_Urgent].slots = runLoop->urgentScheduledCallbacks;
+    runLoop->callbackQueues[kHAPPlatformRunLoopCallbackPriority_Urgent].numSlots =
+            kHAPPlatformRunLoop_NumUrgentScheduledCallbacks;
+    for (size_t i = 0; i < kHAPPlatformRunLoop_NumCallbackPriorities; i++) {
+        HAPPlatformRunLoopCallbackQueue* queue = &runLoop->callbackQueues[i];
+        for (uint32_t j = 0; j < queue->numSlots; j++) {
+            HAPNonnull(queue->slots)[j].sequenceNumber = j;
+            HAPNonnull(queue->slots)[j].coalescingKey = 0;
+            HAPNonnull(queue->slots)[j].callback = NULL;
+            HAPNonnull(queue->slots)[j].contextSize = 0;
+            HAPNonnull(queue->slots)[j].contextReference = NULL;
+        }
+        queue->enqueuePosition = 0;
+        queue->dequeuePosition = 0;
+    }
+    runLoop->isWakeupPending = 0;
+
+    // Prepare file handle dispatch.
+    runLoop->rotatesFileHandleDispatch = options->rotatesFileHandleDispatch;
+    runLoop->fileHandleScanOffset = 0;
+    runLoop->fileHandleDispatchBudget = options->fileHandleDispatchBudget;
+
+    // Prepare idle tasks.
+    runLoop->idleTasks = NULL;
+    runLoop->nextIdleTask = NULL;
+    runLoop->numPendingIdleTasks = 0;
+    runLoop->idleTaskMargin =
+            options->idleTaskMargin ? options->idleTaskMargin : kHAPPlatformRunLoop_DefaultIdleTaskMargin;
+    runLoop->idleTaskBudget =
+            options->idleTaskBudget ? options->idleTaskBudget : kHAPPlatformRunLoop_DefaultIdleTaskBudget;
+
+    // Open loop back
+
+    HAPPrecondition(runLoop->loopbackFileDescriptor == -1);
+    HAPPrecondition(runLoop->loopbackSendFileDescriptor == -1);
+    int fileDescriptor = OpenLoopbackSocket();
 
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
-    addr.sin_port = htons(LOOPBACK_PORT);
+    // Each run loop instance uses its own port from the ephemeral port range.
+    addr.sin_port = htons(0);
     inet_aton("127.0.0.1", &addr.sin_addr);
     if (bind(fileDescriptor, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
         CloseLoopback(fileDescriptor);
@@ -510,11 +3049,32 @@ void HAPPlatformRunLoopCreate(const HAPPlatformRunLoopOptions* options) {
             _errno, __func__, HAP_FILE, __LINE__);
         HAPFatalError();
     }
+    socklen_t addrLength = sizeof addr;
+    if (getsockname(fileDescriptor, (struct sockaddr *)&addr, &addrLength) < 0) {
+        int _errno = errno;
+        CloseLoopback(fileDescriptor);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+            "Loopback socket address lookup failed (log, call 'getsockname').",
+            _errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
 
-    runLoop.loopbackFileDescriptor = fileDescriptor;
+    runLoop->loopbackFileDescriptor = fileDescriptor;
+
+    // The sending side is opened once and shared by all producers.
+    fileDescriptor = OpenLoopbackSocket();
+    if (connect(fileDescriptor, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int _errno = errno;
+        CloseLoopback(fileDescriptor);
+        HAPPlatformLogPOSIXError(kHAPLogType_Error,
+            "Loopback socket connect failed (log, call 'connect').",
+            _errno, __func__, HAP_FILE, __LINE__);
+        HAPFatalError();
+    }
+    runLoop->loopbackSendFileDescriptor = fileDescriptor;
 
-    err = HAPPlatformFileHandleRegister(&runLoop.loopbackFileHandle,
-        runLoop.loopbackFileDescriptor,
+    err = HAPPlatformFileHandleRegister(&runLoop->loopbackFileHandle,
+        runLoop->loopbackFileDescriptor,
         (HAPPlatformFileHandleEvent) {
             .isReadyForReading = true,
             .isReadyForWriting = false,
@@ -522,139 +3082,349 @@ void HAPPlatformRunLoopCreate(const HAPPlatformRunLoopOptions* options) {
         },
         HandleLoopbackFileHandleCallback, NULL);
     if (err) {
-        HAPAssert(err == kHAPError_OutOfResources);
+        HAPAssert(err == kHAPError_InvalidState || err == kHAPError_OutOfResources);
         HAPLogError(&logObject, "Failed to register loopback file handle.");
         HAPFatalError();
     }
-    HAPAssert(runLoop.loopbackFileHandle);
+    HAPAssert(runLoop->loopbackFileHandle);
 
-    runLoop.state = kHAPPlatformRunLoopState_Idle;
+#if HAVE_RUN_LOOP_WATCHDOG
+    StartWatchdog();
+#endif
+
+    runLoop->state = kHAPPlatformRunLoopState_Idle;
     
-    // Issue memory barrier to ensure visibility of write to runLoop.selfPipeFileDescriptor1 on other threads.
+    // Issue memory barrier to ensure visibility of write to runLoop->loopbackSendFileDescriptor on other threads.
     __sync_synchronize();
 }
 
 void HAPPlatformRunLoopRelease(void) {
-    CloseLoopback(runLoop.loopbackFileDescriptor);
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+#if HAVE_RUN_LOOP_WATCHDOG
+    StopWatchdog();
+#endif
+
+    CloseLoopback(runLoop->loopbackSendFileDescriptor);
+    CloseLoopback(runLoop->loopbackFileDescriptor);
+
+    runLoop->loopbackSendFileDescriptor = -1;
+    runLoop->loopbackFileDescriptor = -1;
+
+    if (runLoop->loopbackFileHandle) {
+        HAPPlatformFileHandleDeregister(runLoop->loopbackFileHandle);
+        runLoop->loopbackFileHandle = 0;
+    }
 
-    runLoop.loopbackFileDescriptor = -1;
+    MultiplexerRelease();
 
-    if (runLoop.loopbackFileHandle) {
-        HAPPlatformFileHandleDeregister(runLoop.loopbackFileHandle);
-        runLoop.loopbackFileHandle = 0;
+    if (!runLoop->numTimers && runLoop->timers) {
+        HAPPlatformFreeSafe(runLoop->timers);
+        runLoop->maxTimers = 0;
     }
 
-    runLoop.state = kHAPPlatformRunLoopState_Idle;
+    ReleasePool(&runLoop->fileHandlePool);
+    ReleasePool(&runLoop->timerPool);
 
-    // Issue memory barrier to ensure visibility of write to runLoop.loopbackFileDescriptor1 on other threads.
+    runLoop->idleTasks = NULL;
+    runLoop->nextIdleTask = NULL;
+    runLoop->numPendingIdleTasks = 0;
+
+    runLoop->state = kHAPPlatformRunLoopState_Idle;
+
+    // Issue memory barrier to ensure visibility of write to runLoop->loopbackSendFileDescriptor on other threads.
     __sync_synchronize();
 }
 
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopCreateInstance(HAPPlatformRunLoopRef* runLoop, const HAPPlatformRunLoopOptions* options) {
+    HAPPrecondition(runLoop);
+    HAPPrecondition(options);
+
+    HAPPlatformRunLoop* instance = calloc(1, sizeof *instance);
+    if (!instance) {
+        HAPLogError(&logObject, "Cannot allocate run loop instance.");
+        return kHAPError_OutOfResources;
+    }
+    instance->fileHandleSentinel.fileDescriptor = -1;
+    instance->fileHandleSentinel.prevFileHandle = &instance->fileHandleSentinel;
+    instance->fileHandleSentinel.nextFileHandle = &instance->fileHandleSentinel;
+    instance->fileHandles = &instance->fileHandleSentinel;
+#if HAP_RUN_LOOP_USE_SELECT
+    instance->maxFileDescriptor = -1;
+#elif HAP_RUN_LOOP_USE_EPOLL
+    instance->epollFileDescriptor = -1;
+#endif
+    instance->loopbackFileDescriptor = -1;
+    instance->loopbackSendFileDescriptor = -1;
+
+    // Create the instance on behalf of the current thread.
+    HAPPlatformRunLoop* _Nullable previousRunLoop = currentRunLoop;
+    currentRunLoop = instance;
+    HAPPlatformRunLoopCreate(options);
+    currentRunLoop = previousRunLoop;
+
+    *runLoop = instance;
+    return kHAPError_None;
+}
+
+void HAPPlatformRunLoopReleaseInstance(HAPPlatformRunLoopRef runLoop) {
+    HAPPrecondition(runLoop);
+    HAPPrecondition(runLoop != &defaultRunLoop);
+    HAPPrecondition(runLoop->state == kHAPPlatformRunLoopState_Idle);
+
+    // Timers and file handles that are still registered would outlive the instance. Only the loopback is left.
+    HAPPrecondition(!runLoop->timerPool.statistics.numElements);
+    HAPPrecondition(runLoop->fileHandlePool.statistics.numElements == (runLoop->loopbackFileHandle ? 1 : 0));
+
+    HAPPlatformRunLoop* _Nullable previousRunLoop = currentRunLoop;
+    currentRunLoop = runLoop;
+    HAPPlatformRunLoopRelease();
+    currentRunLoop = previousRunLoop == runLoop ? NULL : previousRunLoop;
+
+    HAPPlatformFreeSafe(runLoop);
+}
+
+void HAPPlatformRunLoopSetCurrent(HAPPlatformRunLoopRef _Nullable runLoop) {
+    currentRunLoop = runLoop;
+}
+
+HAP_RESULT_USE_CHECK
+HAPPlatformRunLoopRef HAPPlatformRunLoopGetCurrent(void) {
+    return GetCurrentRunLoop();
+}
+
 void HAPPlatformRunLoopRun(void) {
-    HAPPrecondition(runLoop.state == kHAPPlatformRunLoopState_Idle);
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    HAPPrecondition(runLoop->state == kHAPPlatformRunLoopState_Idle);
 
     HAPLogInfo(&logObject, "Entering run loop.");
-    runLoop.state = kHAPPlatformRunLoopState_Running;
+    runLoop->state = kHAPPlatformRunLoopState_Running;
     do {
-        fd_set readFileDescriptors;
-        fd_set writeFileDescriptors;
-        fd_set errorFileDescriptors;
-
-        FD_ZERO(&readFileDescriptors);
-        FD_ZERO(&writeFileDescriptors);
-        FD_ZERO(&errorFileDescriptors);
-
-        int maxFileDescriptor = -1;
-
-        HAPPlatformFileHandle* fileHandle = runLoop.fileHandles->nextFileHandle;
-        while (fileHandle != runLoop.fileHandles) {
-            fileHandle->isAwaitingEvents = false;
-            if (fileHandle->fileDescriptor != -1) {
-                if (fileHandle->interests.isReadyForReading) {
-                    HAPAssert(fileHandle->fileDescriptor >= 0);
-                    HAPAssert(fileHandle->fileDescriptor < FD_SETSIZE);
-                    FD_SET(fileHandle->fileDescriptor, &readFileDescriptors);
-                    if (fileHandle->fileDescriptor > maxFileDescriptor) {
-                        maxFileDescriptor = fileHandle->fileDescriptor;
-                    }
-                    fileHandle->isAwaitingEvents = true;
-                }
-                if (fileHandle->interests.isReadyForWriting) {
-                    HAPAssert(fileHandle->fileDescriptor >= 0);
-                    HAPAssert(fileHandle->fileDescriptor < FD_SETSIZE);
-                    FD_SET(fileHandle->fileDescriptor, &writeFileDescriptors);
-                    if (fileHandle->fileDescriptor > maxFileDescriptor) {
-                        maxFileDescriptor = fileHandle->fileDescriptor;
-                    }
-                    fileHandle->isAwaitingEvents = true;
-                }
-                if (fileHandle->interests.hasErrorConditionPending) {
-                    HAPAssert(fileHandle->fileDescriptor >= 0);
-                    HAPAssert(fileHandle->fileDescriptor < FD_SETSIZE);
-                    FD_SET(fileHandle->fileDescriptor, &errorFileDescriptors);
-                    if (fileHandle->fileDescriptor > maxFileDescriptor) {
-                        maxFileDescriptor = fileHandle->fileDescriptor;
-                    }
-                    fileHandle->isAwaitingEvents = true;
-                }
-            }
-            fileHandle = fileHandle->nextFileHandle;
-        }
+        HAPTime timeoutValue;
+        HAPTime* timeout = NULL;
 
-        struct timeval timeoutValue;
-        struct timeval* timeout = NULL;
-
-        HAPTime nextDeadline = runLoop.timers ? runLoop.timers->deadline : 0;
-        if (nextDeadline) {
+        HAPTime nextDeadline = runLoop->numTimers ? HAPNonnull(runLoop->timers[0])->latestDeadline : 0;
+        bool mayProcessIdleTasks = !runLoop->pendingFileHandles && MayProcessIdleTasks();
+        if (runLoop->pendingFileHandles) {
+            // Dispatch of ready file handles has been deferred. Only poll for new events.
+            timeout = &timeoutValue;
+            timeoutValue = 0;
+        } else if (mayProcessIdleTasks) {
+            // Only poll for new events. Idle tasks run below if there are none.
+            timeout = &timeoutValue;
+            timeoutValue = 0;
+        } else if (nextDeadline) {
             HAPTime now = HAPPlatformClockGetCurrent();
-            HAPTime delta;
-            if (nextDeadline > now) {
-                delta = nextDeadline - now;
-            } else {
-                delta = 0;
-            }
             HAPAssert(!timeout);
             timeout = &timeoutValue;
-            timeout->tv_sec = (time_t)(delta / 1000);
-            timeout->tv_usec = (suseconds_t)((delta % 1000) * 1000);
+            timeoutValue = nextDeadline > now ? nextDeadline - now : 0;
+#if HAVE_VIRTUAL_CLOCK
+            // Only poll for ready I/O. The virtual time is advanced to the deadline below.
+            timeoutValue = 0;
+#endif
         }
 
-        HAPAssert(maxFileDescriptor >= -1);
-        HAPAssert(maxFileDescriptor < FD_SETSIZE);
-
-        int e = select(
-                maxFileDescriptor + 1, &readFileDescriptors, &writeFileDescriptors, &errorFileDescriptors, timeout);
-        if (e == -1 && errno == EINTR) {
-            continue;
-        }
-        if (e < 0) {
-            int _errno = errno;
-            HAPAssert(e == -1);
-            HAPPlatformLogPOSIXError(
-                    kHAPLogType_Error, "System call 'select' failed.", _errno, __func__, HAP_FILE, __LINE__);
-            HAPFatalError();
+#if HAVE_RUN_LOOP_STATISTICS
+        runLoop->statistics.numIterations++;
+        uint64_t waitStartTime = HAPPlatformClockGetCurrentMicroseconds();
+#endif
+        MultiplexerWaitForEvents(timeout);
+#if HAVE_RUN_LOOP_STATISTICS
+        uint64_t waitEndTime = HAPPlatformClockGetCurrentMicroseconds();
+        RecordHistogramValue(
+                &runLoop->statistics.blockedDuration,
+                waitEndTime > waitStartTime ? waitEndTime - waitStartTime : 0);
+#endif
+        bool isIdle = mayProcessIdleTasks && !runLoop->pendingFileHandles;
+        bool isWakeupCausedByEvents = mayProcessIdleTasks || runLoop->pendingFileHandles;
+
+#if HAVE_VIRTUAL_CLOCK
+        // If no I/O is ready, jump straight to the next timer deadline.
+        if (nextDeadline && !runLoop->pendingFileHandles && nextDeadline > HAPPlatformClockGetCurrent()) {
+            HAPPlatformClockSetVirtualTime(nextDeadline);
         }
+#endif
+
+        // Refresh the cached time once per iteration. It is used for timers and by callbacks for timeout arithmetic.
+        HAPPlatformClockUpdateLoopTime();
+
+        ProcessExpiredTimers(isWakeupCausedByEvents);
+
+        ProcessPendingFileHandles();
 
-        ProcessExpiredTimers();
+        if (isIdle && MayProcessIdleTasks()) {
+            ProcessIdleTasks();
+        }
 
-        ProcessSelectedFileHandles(&readFileDescriptors, &writeFileDescriptors, &errorFileDescriptors);
-    } while (runLoop.state == kHAPPlatformRunLoopState_Running);
+        if (runLoop->rotatesFileHandleDispatch) {
+            runLoop->fileHandleScanOffset++;
+        }
+    } while (runLoop->state == kHAPPlatformRunLoopState_Running);
 
     HAPLogInfo(&logObject, "Exiting run loop.");
-    HAPAssert(runLoop.state == kHAPPlatformRunLoopState_Stopping);
-    runLoop.state = kHAPPlatformRunLoopState_Idle;
+    HAPAssert(runLoop->state == kHAPPlatformRunLoopState_Stopping);
+    runLoop->state = kHAPPlatformRunLoopState_Idle;
 }
 
 void HAPPlatformRunLoopStop(void) {
-    if (runLoop.state == kHAPPlatformRunLoopState_Running) {
-        runLoop.state = kHAPPlatformRunLoopState_Stopping;
+    HAPPlatformRunLoop* runLoop = GetCurrentRunLoop();
+
+    if (runLoop->state == kHAPPlatformRunLoopState_Running) {
+        runLoop->state = kHAPPlatformRunLoopState_Stopping;
+    }
+}
+
+/**
+ * Claims consecutive slots of a scheduled callback queue.
+ *
+ * - Either all slots are claimed or none. The run loop releases slots in order, so the range is free if its last slot
+ *   is free.
+ *
+ * @param      queue                Scheduled callback queue.
+ * @param      numCallbacks         Number of slots to claim.
+ * @param[out] position             Enqueue position of the first claimed slot.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_OutOfResources If the scheduled callback queue does not have enough free slots.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError ClaimScheduledCallbacks(
+        HAPPlatformRunLoopCallbackQueue* queue,
+        uint32_t numCallbacks,
+        uint32_t* position) {
+    HAPPrecondition(queue);
+    HAPPrecondition(numCallbacks && numCallbacks <= queue->numSlots);
+    HAPPrecondition(position);
+
+    *position = __atomic_load_n(&queue->enqueuePosition, __ATOMIC_RELAXED);
+    for (;;) {
+        uint32_t lastPosition = *position + numCallbacks - 1;
+        const HAPPlatformRunLoopScheduledCallback* scheduledCallback =
+                &HAPNonnull(queue->slots)[lastPosition & (queue->numSlots - 1)];
+        uint32_t sequenceNumber = __atomic_load_n(&scheduledCallback->sequenceNumber, __ATOMIC_ACQUIRE);
+        int32_t difference = (int32_t)(sequenceNumber - lastPosition);
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(
+                        &queue->enqueuePosition,
+                        position,
+                        *position + numCallbacks,
+                        /* weak: */ true,
+                        __ATOMIC_RELAXED,
+                        __ATOMIC_RELAXED)) {
+                return kHAPError_None;
+            }
+        } else if (difference < 0) {
+            HAPLog(&logObject, "Scheduled callback queue is full.");
+            return kHAPError_OutOfResources;
+        } else {
+            *position = __atomic_load_n(&queue->enqueuePosition, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/**
+ * Fills a claimed slot of a scheduled callback queue. The slot is not published.
+ *
+ * @param      scheduledCallback    Claimed slot.
+ * @param      callback             Function to call on the run loop.
+ * @param      context              Context.
+ * @param      contextSize          Context size.
+ * @param      isContextByReference Whether the context pointer is passed instead of a copy of the context.
+ * @param      coalescingKey        Coalescing key. 0 if the callback must not be coalesced.
+ */
+static void FillScheduledCallback(
+        HAPPlatformRunLoopScheduledCallback* scheduledCallback,
+        HAPPlatformRunLoopCallback callback,
+        void* _Nullable context,
+        size_t contextSize,
+        bool isContextByReference,
+        uint32_t coalescingKey) {
+    HAPPrecondition(scheduledCallback);
+    HAPPrecondition(callback);
+    HAPPrecondition(!isContextByReference || context);
+    HAPPrecondition(isContextByReference || contextSize <= UINT8_MAX);
+
+    scheduledCallback->callback = callback;
+    scheduledCallback->contextSize = contextSize;
+    scheduledCallback->coalescingKey = coalescingKey;
+    if (isContextByReference) {
+        scheduledCallback->contextReference = context;
+    } else if (contextSize) {
+        HAPRawBufferCopyBytes(scheduledCallback->context, HAPNonnullVoid(context), contextSize);
+    }
+}
+
+/**
+ * Enqueues a callback into a scheduled callback queue and wakes the run loop.
+ *
+ * @param      runLoop              Run loop.
+ * @param      priority             Priority of the callback.
+ * @param      callback             Function to call on the run loop.
+ * @param      context              Context.
+ * @param      contextSize          Context size.
+ * @param      isContextByReference Whether the context pointer is passed instead of a copy of the context.
+ * @param      coalescingKey        Coalescing key. 0 if the callback must not be coalesced.
+ *
+ * @return kHAPError_None           If successful.
+ * @return kHAPError_Unknown        If the run loop has not been created, or if it could not be woken up. In the latter
+ *                                  case the callback has been queued and is invoked after the next successful wakeup.
+ * @return kHAPError_OutOfResources If the scheduled callback queue is full.
+ */
+HAP_RESULT_USE_CHECK
+static HAPError EnqueueScheduledCallback(
+        HAPPlatformRunLoop* runLoop,
+        HAPPlatformRunLoopCallbackPriority priority,
+        HAPPlatformRunLoopCallback callback,
+        void* _Nullable context,
+        size_t contextSize,
+        bool isContextByReference,
+        uint32_t coalescingKey) {
+    HAPPrecondition(runLoop);
+    HAPPrecondition(priority < kHAPPlatformRunLoop_NumCallbackPriorities);
+    HAPPrecondition(callback);
+    HAPPrecondition(!isContextByReference || context);
+    HAPPrecondition(isContextByReference || contextSize <= UINT8_MAX);
+
+    if (runLoop->loopbackSendFileDescriptor == -1) {
+        // A context that is passed by reference is owned by the callback once the error has been returned.
+        HAPPrecondition(!isContextByReference);
+        HAPLogError(&logObject, "Run loop has not been created.");
+        return kHAPError_Unknown;
+    }
+
+    HAPPlatformRunLoopCallbackQueue* queue = &runLoop->callbackQueues[priority];
+    uint32_t position;
+    HAPError err = ClaimScheduledCallbacks(queue, /* numCallbacks: */ 1, &position);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        return err;
     }
+
+    // Fill and publish the slot.
+    HAPPlatformRunLoopScheduledCallback* scheduledCallback =
+            &HAPNonnull(queue->slots)[position & (queue->numSlots - 1)];
+    FillScheduledCallback(scheduledCallback, callback, context, contextSize, isContextByReference, coalescingKey);
+    __atomic_store_n(&scheduledCallback->sequenceNumber, position + 1, __ATOMIC_RELEASE);
+
+    return SignalLoopback(runLoop);
 }
 
 HAPError HAPPlatformRunLoopScheduleCallback(
         HAPPlatformRunLoopCallback callback,
         void* _Nullable const context,
         size_t contextSize) {
+    return HAPPlatformRunLoopScheduleCallbackOnInstance(GetCurrentRunLoop(), callback, context, contextSize);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbackOnInstance(
+        HAPPlatformRunLoopRef runLoop,
+        HAPPlatformRunLoopCallback callback,
+        void* _Nullable const context,
+        size_t contextSize) {
+    HAPPrecondition(runLoop);
     HAPPrecondition(callback);
     HAPPrecondition(!contextSize || context);
 
@@ -662,59 +3432,143 @@ HAPError HAPPlatformRunLoopScheduleCallback(
         HAPLogError(&logObject, "Contexts larger than UINT8_MAX are not supported.");
         return kHAPError_OutOfResources;
     }
-    if (contextSize + 1 + sizeof callback > PIPE_BUF) {
-        HAPLogError(&logObject, "Context too large (PIPE_BUF).");
+
+    return EnqueueScheduledCallback(
+            runLoop,
+            kHAPPlatformRunLoopCallbackPriority_Normal,
+            callback,
+            context,
+            contextSize,
+            /* isContextByReference: */ false,
+            /* coalescingKey: */ 0);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbackWithOptions(
+        HAPPlatformRunLoopCallback callback,
+        void* _Nullable const context,
+        size_t contextSize,
+        const HAPPlatformRunLoopScheduleOptions* options) {
+    return HAPPlatformRunLoopScheduleCallbackWithOptionsOnInstance(
+            GetCurrentRunLoop(), callback, context, contextSize, options);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbackWithOptionsOnInstance(
+        HAPPlatformRunLoopRef runLoop,
+        HAPPlatformRunLoopCallback callback,
+        void* _Nullable const context,
+        size_t contextSize,
+        const HAPPlatformRunLoopScheduleOptions* options) {
+    HAPPrecondition(runLoop);
+    HAPPrecondition(callback);
+    HAPPrecondition(!contextSize || context);
+    HAPPrecondition(options);
+    HAPPrecondition(
+            options->priority == kHAPPlatformRunLoopCallbackPriority_Normal ||
+            options->priority == kHAPPlatformRunLoopCallbackPriority_Urgent);
+
+    if (contextSize > UINT8_MAX) {
+        HAPLogError(&logObject, "Contexts larger than UINT8_MAX are not supported.");
         return kHAPError_OutOfResources;
     }
 
-    // Serialize event context.
-    // Format: Callback pointer followed by 1 byte context size and context data.
-    // Context is copied to offset 0 when invoking the callback to ensure proper alignment.
-    uint8_t bytes[sizeof callback + 1 + UINT8_MAX];
-    size_t numBytes = 0;
-    HAPRawBufferCopyBytes(&bytes[numBytes], &callback, sizeof callback);
-    numBytes += sizeof callback;
-    bytes[numBytes] = (uint8_t) contextSize;
-    numBytes++;
-    if (context) {
-        HAPRawBufferCopyBytes(&bytes[numBytes], context, contextSize);
-        numBytes += contextSize;
+    return EnqueueScheduledCallback(
+            runLoop,
+            options->priority,
+            callback,
+            context,
+            contextSize,
+            /* isContextByReference: */ false,
+            options->coalescingKey);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbacks(
+        const HAPPlatformRunLoopScheduledCallbackRecord* records,
+        size_t numRecords) {
+    return HAPPlatformRunLoopScheduleCallbacksOnInstance(GetCurrentRunLoop(), records, numRecords);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbacksOnInstance(
+        HAPPlatformRunLoopRef runLoop,
+        const HAPPlatformRunLoopScheduledCallbackRecord* records,
+        size_t numRecords) {
+    HAPPrecondition(runLoop);
+    HAPPrecondition(records);
+
+    if (!numRecords) {
+        return kHAPError_None;
+    }
+    for (size_t i = 0; i < numRecords; i++) {
+        HAPPrecondition(records[i].callback);
+        HAPPrecondition(!records[i].contextSize || records[i].context);
+        if (records[i].contextSize > UINT8_MAX) {
+            HAPLogError(&logObject, "Contexts larger than UINT8_MAX are not supported.");
+            return kHAPError_OutOfResources;
+        }
     }
-    HAPAssert(numBytes <= sizeof bytes);
 
-    int fileDescriptor = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (fileDescriptor < 0) {
-        int _errno = errno;
-        HAPPlatformLogPOSIXError(kHAPLogType_Error,
-            "Loopback client socket failed (log, call 'bind').",
-            _errno, __func__, HAP_FILE, __LINE__);
-        HAPFatalError();
+    if (runLoop->loopbackSendFileDescriptor == -1) {
+        HAPLogError(&logObject, "Run loop has not been created.");
+        return kHAPError_Unknown;
     }
 
-    int e = fcntl(fileDescriptor, F_SETFL, O_NONBLOCK);
-    if (e == -1) {
-        HAPPlatformLogPOSIXError(kHAPLogType_Error,
-            "System call 'fcntl' to set loopback send file descriptor flags to 'non-blocking' failed.",
-            errno, __func__, HAP_FILE, __LINE__);
-        HAPFatalError();
+    HAPPlatformRunLoopCallbackQueue* queue = &runLoop->callbackQueues[kHAPPlatformRunLoopCallbackPriority_Normal];
+    if (numRecords > queue->numSlots) {
+        HAPLog(&logObject, "Scheduled callback queue is too small for %zu callbacks.", numRecords);
+        return kHAPError_OutOfResources;
     }
-    
-    struct sockaddr_in to_addr;
-    to_addr.sin_family = AF_INET;
-    to_addr.sin_port = htons(LOOPBACK_PORT);
-    inet_aton("127.0.0.1", &to_addr.sin_addr);
-    ssize_t n;
-    do {
-        n = sendto(fileDescriptor, bytes, numBytes, 0, (struct sockaddr *)&to_addr, sizeof(to_addr));
-    } while (n == -1 && errno == EINTR);
-    close(fileDescriptor);
-    if (n == -1) {
-        int _errno = errno;
-        HAPPlatformLogPOSIXError(kHAPLogType_Error,
-            "Loopback client socket failed to send data (log, call 'sendto').",
-            _errno, __func__, HAP_FILE, __LINE__);
-        return kHAPError_Unknown;
+    uint32_t position;
+    HAPError err = ClaimScheduledCallbacks(queue, (uint32_t) numRecords, &position);
+    if (err) {
+        HAPAssert(err == kHAPError_OutOfResources);
+        return err;
     }
 
-    return kHAPError_None;
+    // Fill and publish the slots. The first slot is published last so that the run loop, which dequeues in order,
+    // sees either none or all of the batch.
+    for (size_t i = numRecords; i-- > 0;) {
+        HAPPlatformRunLoopScheduledCallback* scheduledCallback =
+                &HAPNonnull(queue->slots)[(position + (uint32_t) i) & (queue->numSlots - 1)];
+        FillScheduledCallback(
+                scheduledCallback,
+                records[i].callback,
+                records[i].context,
+                records[i].contextSize,
+                /* isContextByReference: */ false,
+                /* coalescingKey: */ 0);
+        __atomic_store_n(&scheduledCallback->sequenceNumber, position + (uint32_t) i + 1, __ATOMIC_RELEASE);
+    }
+
+    return SignalLoopback(runLoop);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbackByReference(
+        HAPPlatformRunLoopCallback callback,
+        void* context,
+        size_t contextSize) {
+    return HAPPlatformRunLoopScheduleCallbackByReferenceOnInstance(GetCurrentRunLoop(), callback, context, contextSize);
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformRunLoopScheduleCallbackByReferenceOnInstance(
+        HAPPlatformRunLoopRef runLoop,
+        HAPPlatformRunLoopCallback callback,
+        void* context,
+        size_t contextSize) {
+    HAPPrecondition(runLoop);
+    HAPPrecondition(callback);
+    HAPPrecondition(context);
+
+    return EnqueueScheduledCallback(
+            runLoop,
+            kHAPPlatformRunLoopCallbackPriority_Normal,
+            callback,
+            context,
+            contextSize,
+            /* isContextByReference: */ true,
+            /* coalescingKey: */ 0);
 }
@@ -23,12 +23,15 @@
 #include <net/if.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <esp_event.h>
 
 #include "HAPPlatform+Init.h"
+#include "HAPPlatformClock+Init.h"
 #include "HAPPlatformLog+Init.h"
 #include "HAPPlatformTCPStreamManager+Init.h"
 
@@ -49,6 +52,7 @@ static void InitializeTCPStreamListener(HAPPlatformTCPStreamListener* tcpStreamL
     tcpStreamListener->fileHandle = 0;
     tcpStreamListener->callback = NULL;
     tcpStreamListener->context = NULL;
+    tcpStreamListener->readyTime = 0;
 }
 
 /**
@@ -66,6 +70,132 @@ static void InitializeTCPStream(HAPPlatformTCPStream* tcpStream) {
     tcpStream->interests.hasSpaceAvailable = false;
     tcpStream->callback = NULL;
     tcpStream->context = NULL;
+    tcpStream->acceptTime = 0;
+    tcpStream->openTime = 0;
+    tcpStream->lastActivityTime = 0;
+    HAPRawBufferZero(&tcpStream->counters, sizeof tcpStream->counters);
+    tcpStream->prevTCPStream = NULL;
+    tcpStream->nextTCPStream = NULL;
+}
+
+/**
+ * Takes a TCP stream from the free list and inserts it into the active list.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ *
+ * @return TCP stream.
+ */
+HAP_RESULT_USE_CHECK
+static HAPPlatformTCPStream* ActivateTCPStream(HAPPlatformTCPStreamManagerRef tcpStreamManager) {
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->freeTCPStreams);
+
+    HAPPlatformTCPStream* tcpStream = HAPNonnull(tcpStreamManager->freeTCPStreams);
+    tcpStreamManager->freeTCPStreams = tcpStream->nextTCPStream;
+
+    tcpStream->prevTCPStream = NULL;
+    tcpStream->nextTCPStream = tcpStreamManager->activeTCPStreams;
+    if (tcpStreamManager->activeTCPStreams) {
+        HAPNonnull(tcpStreamManager->activeTCPStreams)->prevTCPStream = tcpStream;
+    }
+    tcpStreamManager->activeTCPStreams = tcpStream;
+    return tcpStream;
+}
+
+/**
+ * Removes a TCP stream from the active list and returns it to the free list.
+ *
+ * - The most recently closed TCP stream is reused first.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param      tcpStream            TCP stream.
+ */
+static void DeactivateTCPStream(HAPPlatformTCPStreamManagerRef tcpStreamManager, HAPPlatformTCPStream* tcpStream) {
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStream);
+
+    if (tcpStream->prevTCPStream) {
+        HAPNonnull(tcpStream->prevTCPStream)->nextTCPStream = tcpStream->nextTCPStream;
+    } else {
+        HAPAssert(tcpStreamManager->activeTCPStreams == tcpStream);
+        tcpStreamManager->activeTCPStreams = tcpStream->nextTCPStream;
+    }
+    if (tcpStream->nextTCPStream) {
+        HAPNonnull(tcpStream->nextTCPStream)->prevTCPStream = tcpStream->prevTCPStream;
+    }
+
+    InitializeTCPStream(tcpStream);
+    tcpStream->nextTCPStream = tcpStreamManager->freeTCPStreams;
+    tcpStreamManager->freeTCPStreams = tcpStream;
+}
+
+/**
+ * Updates the I/O counters of a TCP stream and the aggregate counters of its TCP stream manager after a read.
+ *
+ * - If data has been read, the TCP stream is marked as active.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param      tcpStream            TCP stream.
+ * @param      err                  Result of the read.
+ * @param      numBytes             Number of bytes that have been read.
+ */
+static void CountRead(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStream* tcpStream,
+        HAPError err,
+        size_t numBytes) {
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStream);
+
+    if (numBytes) {
+        tcpStream->lastActivityTime = HAPPlatformClockGetCurrent();
+    }
+
+    HAPPlatformTCPStreamCounters* counters[] = { &tcpStream->counters, &tcpStreamManager->statistics.counters };
+    for (size_t i = 0; i < HAPArrayCount(counters); i++) {
+        counters[i]->numReadCalls++;
+        counters[i]->numBytesRead += numBytes;
+        if (err == kHAPError_Busy) {
+            counters[i]->numBusyReads++;
+        }
+    }
+}
+
+/**
+ * Updates the I/O counters of a TCP stream and the aggregate counters of its TCP stream manager after a write.
+ *
+ * - If data has been written, the TCP stream is marked as active.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param      tcpStream            TCP stream.
+ * @param      err                  Result of the write.
+ * @param      numBytes             Number of bytes that have been written.
+ * @param      maxBytes             Number of bytes that were requested to be written.
+ */
+static void CountWrite(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStream* tcpStream,
+        HAPError err,
+        size_t numBytes,
+        size_t maxBytes) {
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStream);
+    HAPPrecondition(numBytes <= maxBytes);
+
+    if (numBytes) {
+        tcpStream->lastActivityTime = HAPPlatformClockGetCurrent();
+    }
+
+    HAPPlatformTCPStreamCounters* counters[] = { &tcpStream->counters, &tcpStreamManager->statistics.counters };
+    for (size_t i = 0; i < HAPArrayCount(counters); i++) {
+        counters[i]->numWriteCalls++;
+        counters[i]->numBytesWritten += numBytes;
+        if (err == kHAPError_Busy) {
+            counters[i]->numBusyWrites++;
+        } else if (!err && numBytes < maxBytes) {
+            counters[i]->numShortWrites++;
+        }
+    }
 }
 
 HAP_RESULT_USE_CHECK
@@ -130,18 +260,200 @@ static HAPError SetNodelay(int fileDescriptor) {
     return kHAPError_None;
 }
 
+/**
+ * Sets a socket option that tunes the behaviour of a socket.
+ *
+ * - Failures are logged but are otherwise ignored, as not all platforms support all socket options.
+ *
+ * @param      fileDescriptor       Socket file descriptor.
+ * @param      level                Protocol level of the socket option.
+ * @param      optionName           Socket option.
+ * @param      optionDescription    Name of the socket option for logging.
+ * @param      value                Value of the socket option.
+ * @param      numValueBytes        Length of the value of the socket option.
+ */
+static void SetSocketOption(
+        int fileDescriptor,
+        int level,
+        int optionName,
+        const char* optionDescription,
+        const void* value,
+        socklen_t numValueBytes) {
+    HAPPrecondition(optionDescription);
+    HAPPrecondition(value);
+
+    HAPLogBufferDebug(
+            &logObject,
+            value,
+            numValueBytes,
+            "setsockopt(%d, %d, %s, <buffer>);",
+            fileDescriptor,
+            level,
+            optionDescription);
+    int e = setsockopt(fileDescriptor, level, optionName, value, numValueBytes);
+    if (e != 0) {
+        int _errno = errno;
+        HAPAssert(e == -1);
+        HAPLog(&logObject,
+               "System call 'setsockopt' with option '%s' failed: %s. Ignoring.",
+               optionDescription,
+               strerror(_errno));
+    }
+}
+
+/**
+ * Converts a time interval to full seconds, rounding up.
+ *
+ * @param      time                 Time interval.
+ *
+ * @return Time interval in seconds.
+ */
+HAP_RESULT_USE_CHECK
+static int GetSecondsFromTime(HAPTime time) {
+    HAPPrecondition(time <= (HAPTime) INT_MAX * HAPSecond);
+
+    return (int) ((time + HAPSecond - 1) / HAPSecond);
+}
+
+/**
+ * Applies the configured buffer sizes to a socket.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param      fileDescriptor       Socket file descriptor.
+ */
+static void ConfigureBufferSizes(HAPPlatformTCPStreamManagerRef tcpStreamManager, int fileDescriptor) {
+    HAPPrecondition(tcpStreamManager);
+
+    if (tcpStreamManager->tcpStreamConfiguration.receiveBufferSize) {
+        SetSocketOption(
+                fileDescriptor,
+                SOL_SOCKET,
+                SO_RCVBUF,
+                "SO_RCVBUF",
+                &tcpStreamManager->tcpStreamConfiguration.receiveBufferSize,
+                sizeof tcpStreamManager->tcpStreamConfiguration.receiveBufferSize);
+    }
+    if (tcpStreamManager->tcpStreamConfiguration.sendBufferSize) {
+        SetSocketOption(
+                fileDescriptor,
+                SOL_SOCKET,
+                SO_SNDBUF,
+                "SO_SNDBUF",
+                &tcpStreamManager->tcpStreamConfiguration.sendBufferSize,
+                sizeof tcpStreamManager->tcpStreamConfiguration.sendBufferSize);
+    }
+}
+
+/**
+ * Applies the configured socket options to an accepted TCP stream socket.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ * @param      fileDescriptor       Socket file descriptor.
+ */
+static void ConfigureTCPStreamSocket(HAPPlatformTCPStreamManagerRef tcpStreamManager, int fileDescriptor) {
+    HAPPrecondition(tcpStreamManager);
+
+    ConfigureBufferSizes(tcpStreamManager, fileDescriptor);
+
+    if (tcpStreamManager->tcpStreamConfiguration.keepAliveIsEnabled) {
+        int v = 1;
+        SetSocketOption(fileDescriptor, SOL_SOCKET, SO_KEEPALIVE, "SO_KEEPALIVE", &v, sizeof v);
+#if defined(TCP_KEEPIDLE)
+        if (tcpStreamManager->tcpStreamConfiguration.keepAliveIdleTime) {
+            SetSocketOption(
+                    fileDescriptor,
+                    IPPROTO_TCP,
+                    TCP_KEEPIDLE,
+                    "TCP_KEEPIDLE",
+                    &tcpStreamManager->tcpStreamConfiguration.keepAliveIdleTime,
+                    sizeof tcpStreamManager->tcpStreamConfiguration.keepAliveIdleTime);
+        }
+#endif
+#if defined(TCP_KEEPINTVL)
+        if (tcpStreamManager->tcpStreamConfiguration.keepAliveInterval) {
+            SetSocketOption(
+                    fileDescriptor,
+                    IPPROTO_TCP,
+                    TCP_KEEPINTVL,
+                    "TCP_KEEPINTVL",
+                    &tcpStreamManager->tcpStreamConfiguration.keepAliveInterval,
+                    sizeof tcpStreamManager->tcpStreamConfiguration.keepAliveInterval);
+        }
+#endif
+#if defined(TCP_KEEPCNT)
+        if (tcpStreamManager->tcpStreamConfiguration.keepAliveCount) {
+            SetSocketOption(
+                    fileDescriptor,
+                    IPPROTO_TCP,
+                    TCP_KEEPCNT,
+                    "TCP_KEEPCNT",
+                    &tcpStreamManager->tcpStreamConfiguration.keepAliveCount,
+                    sizeof tcpStreamManager->tcpStreamConfiguration.keepAliveCount);
+        }
+#endif
+    }
+
+#if defined(TCP_USER_TIMEOUT)
+    if (tcpStreamManager->tcpStreamConfiguration.userTimeout) {
+        SetSocketOption(
+                fileDescriptor,
+                IPPROTO_TCP,
+                TCP_USER_TIMEOUT,
+                "TCP_USER_TIMEOUT",
+                &tcpStreamManager->tcpStreamConfiguration.userTimeout,
+                sizeof tcpStreamManager->tcpStreamConfiguration.userTimeout);
+    }
+#endif
+
+    if (tcpStreamManager->tcpStreamConfiguration.resetsConnectionOnClose) {
+        // Only abortive close is supported. A nonzero timeout would block the run loop in close.
+        struct linger l = { .l_onoff = 1, .l_linger = 0 };
+        SetSocketOption(fileDescriptor, SOL_SOCKET, SO_LINGER, "SO_LINGER", &l, sizeof l);
+    }
+}
+
 void HAPPlatformTCPStreamManagerCreate(
         HAPPlatformTCPStreamManagerRef tcpStreamManager,
         const HAPPlatformTCPStreamManagerOptions* options) {
     HAPPrecondition(tcpStreamManager);
     HAPPrecondition(options);
     HAPPrecondition(options->maxConcurrentTCPStreams);
-    
+    HAPPrecondition(options->backlog <= INT_MAX);
+    HAPPrecondition(options->receiveBufferSize <= INT_MAX);
+    HAPPrecondition(options->sendBufferSize <= INT_MAX);
+    HAPPrecondition(options->keepAlive.count <= INT_MAX);
+    HAPPrecondition(options->userTimeout <= UINT_MAX);
+
     HAPRawBufferZero(tcpStreamManager, sizeof *tcpStreamManager);
     tcpStreamManager->tcpStreamListenerConfiguration.port = options->port;
+    tcpStreamManager->tcpStreamListenerConfiguration.backlog =
+            (int) (options->backlog ? options->backlog : kHAPPlatformTCPStreamManager_DefaultBacklog);
+    tcpStreamManager->tcpStreamConfiguration.receiveBufferSize = (int) options->receiveBufferSize;
+    tcpStreamManager->tcpStreamConfiguration.sendBufferSize = (int) options->sendBufferSize;
+    tcpStreamManager->tcpStreamConfiguration.keepAliveIsEnabled = options->keepAlive.isEnabled;
+    tcpStreamManager->tcpStreamConfiguration.keepAliveIdleTime = GetSecondsFromTime(options->keepAlive.idleTime);
+    tcpStreamManager->tcpStreamConfiguration.keepAliveInterval = GetSecondsFromTime(options->keepAlive.interval);
+    tcpStreamManager->tcpStreamConfiguration.keepAliveCount = (int) options->keepAlive.count;
+    tcpStreamManager->tcpStreamConfiguration.userTimeout = (unsigned int) options->userTimeout;
+    tcpStreamManager->tcpStreamConfiguration.resetsConnectionOnClose = options->resetsConnectionOnClose;
+    tcpStreamManager->eviction.callback = options->eviction.callback;
+    tcpStreamManager->eviction.context = options->eviction.context;
+    tcpStreamManager->eviction.minIdleTime = options->eviction.minIdleTime;
+#if !defined(TCP_KEEPIDLE) || !defined(TCP_KEEPINTVL) || !defined(TCP_KEEPCNT)
+    if (options->keepAlive.isEnabled &&
+        (options->keepAlive.idleTime || options->keepAlive.interval || options->keepAlive.count)) {
+        HAPLog(&logObject, "TCP keepalive parameters are not fully supported on this platform. Using defaults.");
+    }
+#endif
+#if !defined(TCP_USER_TIMEOUT)
+    if (options->userTimeout) {
+        HAPLog(&logObject, "Socket option 'TCP_USER_TIMEOUT' is not supported on this platform. Ignoring.");
+    }
+#endif
 
     tcpStreamManager->numTCPStreams = 0;
     tcpStreamManager->maxTCPStreams = options->maxConcurrentTCPStreams;
+    tcpStreamManager->batchAccept = options->batchAccept;
 
     HAPLogDebug(&logObject, "Storage configuration: tcpStreamManager = %lu", (unsigned long) sizeof *tcpStreamManager);
     HAPLogDebug(
@@ -158,8 +470,12 @@ void HAPPlatformTCPStreamManagerCreate(
         HAPLogError(&logObject, "Allocating new TCP stream failed: out of memory.");
         HAPFatalError();
     }
-    for (size_t i = 0; i < tcpStreamManager->maxTCPStreams; i++) {
+    tcpStreamManager->freeTCPStreams = NULL;
+    tcpStreamManager->activeTCPStreams = NULL;
+    for (size_t i = tcpStreamManager->maxTCPStreams; i-- > 0;) {
         InitializeTCPStream(&tcpStreamManager->tcpStreams[i]);
+        tcpStreamManager->tcpStreams[i].nextTCPStream = tcpStreamManager->freeTCPStreams;
+        tcpStreamManager->freeTCPStreams = &tcpStreamManager->tcpStreams[i];
     }
 }
 
@@ -167,8 +483,49 @@ void HAPPlatformTCPStreamManagerRelease(HAPPlatformTCPStreamManagerRef tcpStream
     HAPPrecondition(tcpStreamManager);
     HAPPrecondition(tcpStreamManager->tcpStreams);
 
+    // Close TCP streams that are still open, so that their sockets and file handles are not leaked.
+    while (tcpStreamManager->activeTCPStreams) {
+        HAPPlatformTCPStream* tcpStream = HAPNonnull(tcpStreamManager->activeTCPStreams);
+        HAPLog(&logObject, "Closing TCP stream %p that is still open.", (const void*) tcpStream);
+        HAPPlatformTCPStreamClose(tcpStreamManager, (HAPPlatformTCPStreamRef) tcpStream);
+    }
+    HAPAssert(!tcpStreamManager->numTCPStreams);
+    HAPAssert(!tcpStreamManager->eviction.retryTimer);
+
     HAPPlatformFreeSafe(tcpStreamManager->tcpStreams);
     tcpStreamManager->tcpStreams = NULL;
+    tcpStreamManager->freeTCPStreams = NULL;
+}
+
+void HAPPlatformTCPStreamManagerGetStatistics(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamManagerStatistics* statistics) {
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(statistics);
+
+    *statistics = tcpStreamManager->statistics;
+}
+
+void HAPPlatformTCPStreamManagerGetTCPStreamStatistics(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamStatistics* statistics,
+        size_t maxStatistics,
+        size_t* numStatistics) {
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(statistics);
+    HAPPrecondition(numStatistics);
+
+    HAPTime now = HAPPlatformClockGetCurrent();
+
+    *numStatistics = 0;
+    for (HAPPlatformTCPStream* tcpStream = tcpStreamManager->activeTCPStreams;
+         tcpStream && *numStatistics < maxStatistics;
+         tcpStream = tcpStream->nextTCPStream) {
+        HAPPlatformTCPStreamStatistics* tcpStreamStatistics = &statistics[(*numStatistics)++];
+        tcpStreamStatistics->tcpStream = (HAPPlatformTCPStreamRef) tcpStream;
+        tcpStreamStatistics->counters = tcpStream->counters;
+        tcpStreamStatistics->lifetime = now - tcpStream->openTime;
+    }
 }
 
 HAP_RESULT_USE_CHECK
@@ -274,8 +631,11 @@ void HAPPlatformTCPStreamManagerOpenListener(
     }
     HAPLogDebug(&logObject, "TCP stream listener port: %u.", port);
 
-    HAPLogDebug(&logObject, "listen(%d, 64);", fileDescriptor);
-    e = listen(fileDescriptor, 64);
+    ConfigureBufferSizes(tcpStreamManager, fileDescriptor);
+
+    int backlog = tcpStreamManager->tcpStreamListenerConfiguration.backlog;
+    HAPLogDebug(&logObject, "listen(%d, %d);", fileDescriptor, backlog);
+    e = listen(fileDescriptor, backlog);
     if (e != 0) {
         _errno = errno;
         HAPAssert(e == -1);
@@ -322,6 +682,11 @@ void HAPPlatformTCPStreamManagerCloseListener(HAPPlatformTCPStreamManagerRef tcp
 
     int e;
 
+    if (tcpStreamManager->eviction.retryTimer) {
+        HAPPlatformTimerDeregister(tcpStreamManager->eviction.retryTimer);
+        tcpStreamManager->eviction.retryTimer = 0;
+    }
+
     HAPPlatformFileHandleDeregister(tcpStreamManager->tcpStreamListener.fileHandle);
 
     HAPLogDebug(&logObject, "shutdown(%d, SHUT_RDWR);", tcpStreamManager->tcpStreamListener.fileDescriptor);
@@ -375,24 +740,13 @@ HAPError HAPPlatformTCPStreamManagerAcceptTCPStream(
 
     if (tcpStreamManager->numTCPStreams == tcpStreamManager->maxTCPStreams) {
         HAPLog(&logObject, "Cannot accept more TCP streams.");
+        tcpStreamManager->statistics.numRefusedTCPStreams++;
         *tcpStream_ = (HAPPlatformTCPStreamRef) NULL;
         return kHAPError_OutOfResources;
     }
 
     HAPAssert(tcpStreamManager->numTCPStreams < tcpStreamManager->maxTCPStreams);
-
-    // Find free TCP stream.
-    size_t i = 0;
-    while ((i < tcpStreamManager->maxTCPStreams) && (tcpStreamManager->tcpStreams[i].fileDescriptor != -1)) {
-        i++;
-    }
-    HAPAssert(i < tcpStreamManager->maxTCPStreams);
-
-    HAPPlatformTCPStream* tcpStream = &tcpStreamManager->tcpStreams[i];
-
-    HAPAssert(!tcpStream->tcpStreamManager);
-    HAPAssert(tcpStream->fileDescriptor == -1);
-    HAPAssert(!tcpStream->fileHandle);
+    HAPAssert(tcpStreamManager->freeTCPStreams);
 
     HAPLogDebug(&logObject, "accept(%d, NULL, NULL);", tcpStreamManager->tcpStreamListener.fileDescriptor);
     int fileDescriptor = accept(tcpStreamManager->tcpStreamListener.fileDescriptor, NULL, NULL);
@@ -414,6 +768,12 @@ HAPError HAPPlatformTCPStreamManagerAcceptTCPStream(
         return kHAPError_Busy;
     }
 
+    // Take free TCP stream.
+    HAPPlatformTCPStream* tcpStream = ActivateTCPStream(tcpStreamManager);
+    HAPAssert(!tcpStream->tcpStreamManager);
+    HAPAssert(tcpStream->fileDescriptor == -1);
+    HAPAssert(!tcpStream->fileHandle);
+
     // Configure socket.
     int e = SetNonblocking(fileDescriptor);
     if (e != 0) {
@@ -425,6 +785,7 @@ HAPError HAPPlatformTCPStreamManagerAcceptTCPStream(
         HAPLogError(&logObject, "Failed to disable Nagle's algorithm for TCP stream socket.");
         HAPFatalError();
     }
+    ConfigureTCPStreamSocket(tcpStreamManager, fileDescriptor);
 
     HAPPlatformFileHandleRef fileHandle;
     err = HAPPlatformFileHandleRegister(
@@ -447,12 +808,19 @@ HAPError HAPPlatformTCPStreamManagerAcceptTCPStream(
     HAPAssert(!tcpStream->interests.hasSpaceAvailable);
     HAPAssert(!tcpStream->callback);
     HAPAssert(!tcpStream->context);
+    tcpStream->acceptTime = tcpStreamManager->tcpStreamListener.readyTime ?
+                                    tcpStreamManager->tcpStreamListener.readyTime :
+                                    HAPPlatformClockGetCurrentMicroseconds();
+    tcpStream->openTime = HAPPlatformClockGetCurrent();
+    tcpStream->lastActivityTime = tcpStream->openTime;
 
     *tcpStream_ = (HAPPlatformTCPStreamRef) tcpStream;
 
     tcpStreamManager->numTCPStreams++;
+    tcpStreamManager->statistics.numAcceptedTCPStreams++;
 
-    if (tcpStreamManager->maxTCPStreams - tcpStreamManager->numTCPStreams == 0) {
+    if (tcpStreamManager->maxTCPStreams - tcpStreamManager->numTCPStreams == 0 &&
+        !tcpStreamManager->eviction.callback) {
         HAPLogInfo(&logObject, "Suspending accepting new TCP streams on TCP stream listener socket.");
         HAPPlatformFileHandleUpdateInterests(
                 tcpStreamManager->tcpStreamListener.fileHandle,
@@ -536,7 +904,21 @@ void HAPPlatformTCPStreamClose(HAPPlatformTCPStreamManagerRef tcpStreamManager,
                 __LINE__);
     }
 
-    InitializeTCPStream(tcpStream);
+    HAPTime lifetime = HAPPlatformClockGetCurrent() - tcpStream->openTime;
+    HAPLogDebug(
+            &logObject,
+            "TCP stream %p closed after %llu ms: %llu bytes read, %llu bytes written.",
+            (const void*) tcpStream,
+            (unsigned long long) lifetime,
+            (unsigned long long) tcpStream->counters.numBytesRead,
+            (unsigned long long) tcpStream->counters.numBytesWritten);
+    tcpStreamManager->statistics.numClosedTCPStreams++;
+    tcpStreamManager->statistics.totalLifetime += lifetime;
+    if (lifetime > tcpStreamManager->statistics.maxLifetime) {
+        tcpStreamManager->statistics.maxLifetime = lifetime;
+    }
+
+    DeactivateTCPStream(tcpStreamManager, tcpStream);
 
     HAPAssert(tcpStreamManager->numTCPStreams <= tcpStreamManager->maxTCPStreams);
 
@@ -547,6 +929,10 @@ void HAPPlatformTCPStreamClose(HAPPlatformTCPStreamManagerRef tcpStreamManager,
     if (tcpStreamManager->tcpStreamListener.fileDescriptor != -1) {
         HAPAssert(tcpStreamManager->tcpStreamListener.tcpStreamManager == tcpStreamManager);
         HAPAssert(tcpStreamManager->tcpStreamListener.fileHandle);
+        if (tcpStreamManager->eviction.retryTimer) {
+            HAPPlatformTimerDeregister(tcpStreamManager->eviction.retryTimer);
+            tcpStreamManager->eviction.retryTimer = 0;
+        }
         if (tcpStreamManager->maxTCPStreams - tcpStreamManager->numTCPStreams == 1) {
             HAPLogInfo(&logObject, "Resuming accepting new TCP streams on TCP stream listener socket.");
             HAPPlatformFileHandleUpdateInterests(
@@ -625,17 +1011,36 @@ HAPError HAPPlatformTCPStreamRead(
                     __func__,
                     HAP_FILE,
                     __LINE__);
+            CountRead(tcpStreamManager, tcpStream, kHAPError_Unknown, 0);
             *numBytes = 0;
             return kHAPError_Unknown;
         }
 
         HAPLogDebug(&logObject, "System call 'recv' on TCP stream socket is busy.");
+        CountRead(tcpStreamManager, tcpStream, kHAPError_Busy, 0);
         *numBytes = 0;
         return kHAPError_Busy;
     }
 
     HAPAssert(n >= 0);
     HAPAssert((size_t) n <= maxBytes);
+
+    if (n && tcpStream->acceptTime) {
+        // First read since the TCP stream has been accepted.
+        uint64_t now = HAPPlatformClockGetCurrentMicroseconds();
+        uint64_t latency = now > tcpStream->acceptTime ? now - tcpStream->acceptTime : 0;
+        tcpStream->acceptTime = 0;
+
+        HAPPlatformTCPStreamManagerStatistics* statistics = &tcpStreamManager->statistics;
+        statistics->numAcceptLatencySamples++;
+        statistics->totalAcceptLatency += latency;
+        if (latency > statistics->maxAcceptLatency) {
+            statistics->maxAcceptLatency = latency;
+        }
+        HAPLogDebug(&logObject, "TCP stream accept latency: %llu us.", (unsigned long long) latency);
+    }
+
+    CountRead(tcpStreamManager, tcpStream, kHAPError_None, (size_t) n);
     *numBytes = (size_t) n;
     return kHAPError_None;
 }
@@ -672,21 +1077,220 @@ HAPError HAPPlatformTCPStreamWrite(
                     __func__,
                     HAP_FILE,
                     __LINE__);
+            CountWrite(tcpStreamManager, tcpStream, kHAPError_Unknown, 0, maxBytes);
             *numBytes = 0;
             return kHAPError_Unknown;
         }
 
         HAPLogDebug(&logObject, "System call 'send' on TCP stream socket is busy.");
+        CountWrite(tcpStreamManager, tcpStream, kHAPError_Busy, 0, maxBytes);
         *numBytes = 0;
         return kHAPError_Busy;
     }
 
     HAPAssert(n >= 0);
     HAPAssert((size_t) n <= maxBytes);
+    CountWrite(tcpStreamManager, tcpStream, kHAPError_None, (size_t) n, maxBytes);
     *numBytes = (size_t) n;
     return kHAPError_None;
 }
 
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformTCPStreamWritev(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamRef tcpStream_,
+        const HAPPlatformTCPStreamWriteBuffer* buffers,
+        size_t numBuffers,
+        size_t* numBytes) {
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreams);
+    HAPPrecondition(tcpStream_);
+    HAPPrecondition(buffers);
+    HAPPrecondition(numBuffers <= kHAPPlatformTCPStream_MaxWriteBuffers);
+    HAPPrecondition(numBytes);
+
+    HAPPlatformTCPStream* tcpStream = (HAPPlatformTCPStream*) tcpStream_;
+
+    HAPPrecondition(tcpStream->tcpStreamManager == tcpStreamManager);
+    HAPPrecondition(tcpStream->fileDescriptor != -1);
+    HAPPrecondition(tcpStream->fileHandle);
+
+    struct iovec iov[kHAPPlatformTCPStream_MaxWriteBuffers];
+    size_t numIOVs = 0;
+    size_t maxBytes = 0;
+    for (size_t i = 0; i < numBuffers; i++) {
+        if (!buffers[i].numBytes) {
+            continue;
+        }
+        HAPPrecondition(buffers[i].bytes);
+        iov[numIOVs].iov_base = (void*) (uintptr_t) buffers[i].bytes;
+        iov[numIOVs].iov_len = buffers[i].numBytes;
+        numIOVs++;
+        maxBytes += buffers[i].numBytes;
+    }
+    if (!numIOVs) {
+        *numBytes = 0;
+        return kHAPError_None;
+    }
+
+    struct msghdr message;
+    HAPRawBufferZero(&message, sizeof message);
+    message.msg_iov = iov;
+    message.msg_iovlen = (int) numIOVs;
+
+    ssize_t n;
+    do {
+        n = sendmsg(tcpStream->fileDescriptor, &message, 0);
+    } while ((n == -1) && (errno == EINTR));
+    if (n == -1) {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            HAPPlatformLogPOSIXError(
+                    kHAPLogType_Default,
+                    "System call 'sendmsg' on TCP stream socket failed.",
+                    errno,
+                    __func__,
+                    HAP_FILE,
+                    __LINE__);
+            CountWrite(tcpStreamManager, tcpStream, kHAPError_Unknown, 0, maxBytes);
+            *numBytes = 0;
+            return kHAPError_Unknown;
+        }
+
+        HAPLogDebug(&logObject, "System call 'sendmsg' on TCP stream socket is busy.");
+        CountWrite(tcpStreamManager, tcpStream, kHAPError_Busy, 0, maxBytes);
+        *numBytes = 0;
+        return kHAPError_Busy;
+    }
+
+    HAPAssert(n >= 0);
+    HAPAssert((size_t) n <= maxBytes);
+    CountWrite(tcpStreamManager, tcpStream, kHAPError_None, (size_t) n, maxBytes);
+    *numBytes = (size_t) n;
+    return kHAPError_None;
+}
+
+/**
+ * Returns whether a TCP stream has been less recently active than another TCP stream.
+ *
+ * - Ties are broken by address so that TCP streams are totally ordered.
+ *
+ * @param      tcpStream            TCP stream.
+ * @param      otherTCPStream       Other TCP stream.
+ *
+ * @return true                     If tcpStream has been less recently active than otherTCPStream.
+ * @return false                    Otherwise.
+ */
+HAP_RESULT_USE_CHECK
+static bool IsLessRecentlyActive(const HAPPlatformTCPStream* tcpStream, const HAPPlatformTCPStream* otherTCPStream) {
+    HAPPrecondition(tcpStream);
+    HAPPrecondition(otherTCPStream);
+
+    if (tcpStream->lastActivityTime != otherTCPStream->lastActivityTime) {
+        return tcpStream->lastActivityTime < otherTCPStream->lastActivityTime;
+    }
+    return (uintptr_t) tcpStream < (uintptr_t) otherTCPStream;
+}
+
+/**
+ * Offers idle TCP streams to the eviction callback in least recently active order until one of them is closed.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ *
+ * @return true                     If a TCP stream has been closed.
+ * @return false                    If no TCP stream has been closed.
+ */
+HAP_RESULT_USE_CHECK
+static bool EvictTCPStream(HAPPlatformTCPStreamManagerRef tcpStreamManager) {
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->eviction.callback);
+
+    HAPTime now = HAPPlatformClockGetCurrent();
+    const HAPPlatformTCPStream* _Nullable previousCandidate = NULL;
+    for (;;) {
+        // Find the least recently active idle TCP stream that has not been offered yet.
+        HAPPlatformTCPStream* _Nullable candidate = NULL;
+        for (HAPPlatformTCPStream* tcpStream = tcpStreamManager->activeTCPStreams; tcpStream;
+             tcpStream = tcpStream->nextTCPStream) {
+            if (now - tcpStream->lastActivityTime < tcpStreamManager->eviction.minIdleTime) {
+                continue;
+            }
+            if (previousCandidate && !IsLessRecentlyActive(HAPNonnull(previousCandidate), tcpStream)) {
+                continue;
+            }
+            if (!candidate || IsLessRecentlyActive(tcpStream, HAPNonnull(candidate))) {
+                candidate = tcpStream;
+            }
+        }
+        if (!candidate) {
+            return false;
+        }
+
+        HAPTime idleTime = now - candidate->lastActivityTime;
+        HAPLogInfo(
+                &logObject,
+                "Asking to close TCP stream %p (idle for %llu ms) to admit a new connection.",
+                (const void*) candidate,
+                (unsigned long long) idleTime);
+        size_t numTCPStreams = tcpStreamManager->numTCPStreams;
+        tcpStreamManager->eviction.callback(
+                tcpStreamManager, (HAPPlatformTCPStreamRef) candidate, idleTime, tcpStreamManager->eviction.context);
+        if (tcpStreamManager->numTCPStreams < numTCPStreams) {
+            tcpStreamManager->statistics.numEvictedTCPStreams++;
+            return true;
+        }
+        previousCandidate = candidate;
+    }
+}
+
+static void HandleEvictionRetryTimerExpired(HAPPlatformTimerRef timer, void* _Nullable context) {
+    HAPAssert(context);
+
+    HAPPlatformTCPStreamManagerRef tcpStreamManager = context;
+    HAPAssert(timer == tcpStreamManager->eviction.retryTimer);
+    tcpStreamManager->eviction.retryTimer = 0;
+
+    HAPAssert(tcpStreamManager->tcpStreamListener.fileHandle);
+    HAPLogInfo(&logObject, "Resuming accepting new TCP streams on TCP stream listener socket.");
+    HAPPlatformFileHandleUpdateInterests(
+            tcpStreamManager->tcpStreamListener.fileHandle,
+            (HAPPlatformFileHandleEvent) {
+                    .isReadyForReading = true, .isReadyForWriting = false, .hasErrorConditionPending = false },
+            HandleTCPStreamListenerFileHandleCallback,
+            &tcpStreamManager->tcpStreamListener);
+}
+
+/**
+ * Suspends the TCP stream listener after no TCP stream could be evicted to admit a pending connection,
+ * and schedules a retry.
+ *
+ * @param      tcpStreamManager     TCP stream manager.
+ */
+static void SuspendTCPStreamListenerForEviction(HAPPlatformTCPStreamManagerRef tcpStreamManager) {
+    HAPPrecondition(tcpStreamManager);
+    HAPPrecondition(tcpStreamManager->tcpStreamListener.fileHandle);
+    HAPPrecondition(!tcpStreamManager->eviction.retryTimer);
+
+    HAPError err;
+
+    HAPLogInfo(&logObject, "No TCP stream could be closed to admit a new connection. Suspending TCP stream listener.");
+    HAPPlatformFileHandleUpdateInterests(
+            tcpStreamManager->tcpStreamListener.fileHandle,
+            (HAPPlatformFileHandleEvent) {
+                    .isReadyForReading = false, .isReadyForWriting = false, .hasErrorConditionPending = false },
+            HandleTCPStreamListenerFileHandleCallback,
+            &tcpStreamManager->tcpStreamListener);
+
+    err = HAPPlatformTimerRegister(
+            &tcpStreamManager->eviction.retryTimer,
+            HAPPlatformClockGetCurrent() + kHAPPlatformTCPStreamManager_EvictionRetryInterval,
+            HandleEvictionRetryTimerExpired,
+            tcpStreamManager);
+    if (err) {
+        HAPLogError(&logObject, "Failed to register eviction retry timer.");
+        HAPFatalError();
+    }
+}
+
 static void HandleTCPStreamListenerFileHandleCallback(
         HAPPlatformFileHandleRef fileHandle,
         HAPPlatformFileHandleEvent fileHandleEvents,
@@ -703,7 +1307,48 @@ static void HandleTCPStreamListenerFileHandleCallback(
 
     HAPAssert(fileHandleEvents.isReadyForReading);
 
-    listener->callback(listener->tcpStreamManager, listener->context);
+    HAPPlatformTCPStreamManagerRef tcpStreamManager = listener->tcpStreamManager;
+    HAPPlatformTCPStreamManagerStatistics* statistics = &tcpStreamManager->statistics;
+
+    if (tcpStreamManager->numTCPStreams == tcpStreamManager->maxTCPStreams) {
+        // The listener is only kept active at capacity if eviction is enabled.
+        HAPAssert(tcpStreamManager->eviction.callback);
+        if (!EvictTCPStream(tcpStreamManager)) {
+            SuspendTCPStreamListenerForEviction(tcpStreamManager);
+            return;
+        }
+        if (listener->fileDescriptor == -1) {
+            return;
+        }
+    }
+
+    listener->readyTime = HAPPlatformClockGetCurrentMicroseconds();
+
+    // The listener callback accepts at most one TCP stream. In batch mode, keep invoking it until it no longer
+    // accepts a TCP stream (backlog drained or accept failed), capacity is exhausted, or the listener is closed.
+    uint32_t numAccepts = 0;
+    for (;;) {
+        uint32_t numAcceptedTCPStreams = statistics->numAcceptedTCPStreams;
+        listener->callback(tcpStreamManager, listener->context);
+        if (statistics->numAcceptedTCPStreams == numAcceptedTCPStreams) {
+            break;
+        }
+        numAccepts++;
+
+        if (!tcpStreamManager->batchAccept || listener->fileDescriptor == -1 ||
+            tcpStreamManager->numTCPStreams == tcpStreamManager->maxTCPStreams) {
+            break;
+        }
+    }
+    listener->readyTime = 0;
+
+    statistics->numAcceptEvents++;
+    if (numAccepts > statistics->maxAcceptsPerEvent) {
+        statistics->maxAcceptsPerEvent = numAccepts;
+    }
+    if (numAccepts > 1) {
+        HAPLogDebug(&logObject, "Accepted %u TCP streams in a single listener event.", (unsigned int) numAccepts);
+    }
 }
 
 static void HandleTCPStreamFileHandleCallback(
@@ -0,0 +1,307 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "HAPPlatform.h"
+#include "HAPPlatform+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+#include "HAPPlatformWorkQueue+Init.h"
+
+static const HAPLogObject logObject = { .subsystem = kHAPPlatform_LogSubsystem, .category = "WorkQueue" };
+
+/**
+ * Core to which the worker tasks are pinned.
+ */
+#if defined(CONFIG_FREERTOS_UNICORE) && CONFIG_FREERTOS_UNICORE
+#define kHAPPlatformWorkQueue_CoreID tskNO_AFFINITY
+#else
+#define kHAPPlatformWorkQueue_CoreID CONFIG_HAP_WORK_QUEUE_CORE_ID
+#endif
+
+/**
+ * Interval at which a worker task reports that a completion is still waiting for room in the scheduled callback queue
+ * of a run loop, in milliseconds.
+ *
+ * - The run loop drains its queue in every iteration, so the queue only stays full while the run loop is busy, e.g.,
+ *   with a slow key-value store commit.
+ */
+#define kHAPPlatformWorkQueue_CompletionDelayLogInterval ((uint32_t) 5000)
+
+/**
+ * Maximum interval between attempts to deliver a completion, in milliseconds.
+ */
+#define kHAPPlatformWorkQueue_MaxCompletionRetryInterval ((uint32_t) 100)
+
+static struct {
+    /**
+     * Queue of pending work items. A NULL work item requests a worker task to stop.
+     */
+    QueueHandle_t _Nullable queue;
+
+    /**
+     * Counting semaphore that is given by each worker task when it stops.
+     */
+    SemaphoreHandle_t _Nullable stoppedWorkers;
+
+    /**
+     * Number of worker tasks.
+     */
+    size_t numWorkers;
+
+    /**
+     * Maximum number of work items that may be pending at a time.
+     */
+    size_t maxPendingWork;
+
+    /**
+     * Number of work items that have been submitted but not yet picked up by a worker task.
+     */
+    size_t numPendingWork;
+
+    /**
+     * Run loop that is releasing the work queue. It cannot drain its scheduled callback queue until all worker tasks
+     * have stopped.
+     */
+    HAPPlatformRunLoopRef _Nullable releasingRunLoop;
+
+    /**
+     * Executed work items whose completion could not be scheduled on the releasing run loop, most recent first.
+     */
+    HAPPlatformWork* _Nullable parkedWork;
+} workQueue;
+
+/**
+ * Invokes the completion callback of a work item on the run loop.
+ *
+ * @param      context              Work item.
+ * @param      contextSize          Size of the work item.
+ */
+static void HandleWorkCompletedCallback(void* _Nullable context, size_t contextSize) {
+    HAPPrecondition(context);
+    HAPPrecondition(contextSize == sizeof(HAPPlatformWork));
+    HAPPlatformWork* work = context;
+    HAPPrecondition(work->completionCallback);
+
+    // Reset the work item first, so that it may be resubmitted by the completion callback.
+    HAPPlatformWorkCompletionCallback completionCallback = HAPNonnull(work->completionCallback);
+    void* _Nullable workContext = work->context;
+    work->callback = NULL;
+    work->completionCallback = NULL;
+    work->context = NULL;
+    work->runLoop = NULL;
+
+    completionCallback(work, workContext);
+}
+
+/**
+ * Parks an executed work item whose completion cannot be scheduled on the releasing run loop. Its completion callback
+ * is invoked by HAPPlatformWorkQueueRelease once all worker tasks have stopped.
+ *
+ * @param      work                 Work item.
+ */
+static void ParkWorkCompletion(HAPPlatformWork* work) {
+    HAPPrecondition(work);
+
+    HAPPlatformWork* _Nullable parkedWork = __atomic_load_n(&workQueue.parkedWork, __ATOMIC_RELAXED);
+    do {
+        work->nextWork = parkedWork;
+    } while (!__atomic_compare_exchange_n(
+            &workQueue.parkedWork, &parkedWork, work, /* weak: */ true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/**
+ * Schedules the completion callback of a work item on the run loop that submitted it.
+ *
+ * - If the scheduled callback queue of the run loop is full, scheduling is retried with exponential backoff until it
+ *   succeeds. The delay is logged every kHAPPlatformWorkQueue_CompletionDelayLogInterval.
+ *
+ * - If the run loop is releasing the work queue, it cannot drain its queue until the worker tasks have stopped. The
+ *   completion is parked instead.
+ *
+ * @param      work                 Work item.
+ */
+static void ScheduleWorkCompletion(HAPPlatformWork* work) {
+    HAPPrecondition(work);
+    HAPPrecondition(work->runLoop);
+
+    const TickType_t logInterval = pdMS_TO_TICKS(kHAPPlatformWorkQueue_CompletionDelayLogInterval);
+    const TickType_t maxRetryInterval =
+            HAPMax(pdMS_TO_TICKS(kHAPPlatformWorkQueue_MaxCompletionRetryInterval), (TickType_t) 1);
+    TickType_t retryInterval = 1;
+    TickType_t delay = 0;
+    TickType_t nextLogDelay = logInterval;
+    for (;;) {
+        HAPError err = HAPPlatformRunLoopScheduleCallbackByReferenceOnInstance(
+                HAPNonnull(work->runLoop), HandleWorkCompletedCallback, work, sizeof *work);
+        if (!err) {
+            return;
+        }
+        if (err != kHAPError_OutOfResources) {
+            // The completion has been queued but the run loop could not be woken up.
+            HAPAssert(err == kHAPError_Unknown);
+            HAPLogError(&logObject, "Completion of work item %p is delayed until the next wakeup.", (void*) work);
+            return;
+        }
+
+        if (__atomic_load_n(&workQueue.releasingRunLoop, __ATOMIC_ACQUIRE) == work->runLoop) {
+            ParkWorkCompletion(work);
+            return;
+        }
+        if (!delay) {
+            HAPLog(&logObject, "Scheduled callback queue is full. Delaying completion of work item %p.", (void*) work);
+        } else if (delay >= nextLogDelay) {
+            HAPLogError(
+                    &logObject,
+                    "Run loop has not accepted completion of work item %p for %lu ms.",
+                    (void*) work,
+                    (unsigned long) (delay * portTICK_PERIOD_MS));
+            nextLogDelay += logInterval;
+        }
+        vTaskDelay(retryInterval);
+        delay += retryInterval;
+        retryInterval = HAPMin(2 * retryInterval, maxRetryInterval);
+    }
+}
+
+/**
+ * Worker task. Executes work items until it receives a stop request.
+ *
+ * @param      context              Unused.
+ */
+static void WorkerTask(void* _Nullable context HAP_UNUSED) {
+    for (;;) {
+        HAPPlatformWork* _Nullable work = NULL;
+        if (xQueueReceive(workQueue.queue, &work, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        if (!work) {
+            break;
+        }
+        HAPAssert(__atomic_load_n(&workQueue.numPendingWork, __ATOMIC_RELAXED));
+        __atomic_sub_fetch(&workQueue.numPendingWork, 1, __ATOMIC_RELAXED);
+
+        HAPAssert(work->callback);
+        work->callback(work, work->context);
+
+        // Deliver completion on the run loop that submitted the work item.
+        ScheduleWorkCompletion(work);
+    }
+
+    xSemaphoreGive(workQueue.stoppedWorkers);
+    vTaskDelete(NULL);
+}
+
+void HAPPlatformWorkQueueCreate(const HAPPlatformWorkQueueOptions* options) {
+    HAPPrecondition(options);
+    HAPPrecondition(!workQueue.queue);
+
+    size_t numWorkers = options->numWorkers ? options->numWorkers : CONFIG_HAP_WORK_QUEUE_NUM_WORKERS;
+    size_t maxPendingWork =
+            options->maxPendingWork ? options->maxPendingWork : kHAPPlatformWorkQueue_DefaultMaxPendingWork;
+    HAPLogDebug(&logObject, "Storage configuration: numWorkers = %lu", (unsigned long) numWorkers);
+    HAPLogDebug(&logObject, "Storage configuration: maxPendingWork = %lu", (unsigned long) maxPendingWork);
+
+    // Stop requests are queued behind pending work items, so the queue needs room for one per worker.
+    workQueue.queue = xQueueCreate((UBaseType_t)(maxPendingWork + numWorkers), sizeof(HAPPlatformWork*));
+    workQueue.stoppedWorkers = xSemaphoreCreateCounting((UBaseType_t) numWorkers, 0);
+    if (!workQueue.queue || !workQueue.stoppedWorkers) {
+        HAPLogError(&logObject, "Cannot create work queue.");
+        HAPFatalError();
+    }
+    workQueue.numWorkers = numWorkers;
+    workQueue.maxPendingWork = maxPendingWork;
+
+    for (size_t i = 0; i < numWorkers; i++) {
+        if (xTaskCreatePinnedToCore(
+                    WorkerTask,
+                    "hap_worker",
+                    CONFIG_HAP_WORK_QUEUE_STACK_SIZE,
+                    NULL,
+                    CONFIG_HAP_WORK_QUEUE_TASK_PRIORITY,
+                    NULL,
+                    kHAPPlatformWorkQueue_CoreID) != pdPASS) {
+            HAPLogError(&logObject, "Cannot create worker task.");
+            HAPFatalError();
+        }
+    }
+}
+
+void HAPPlatformWorkQueueRelease(void) {
+    if (!workQueue.queue) {
+        return;
+    }
+
+    // Workers that cannot schedule a completion on this run loop park it instead of waiting for room.
+    __atomic_store_n(&workQueue.releasingRunLoop, HAPPlatformRunLoopGetCurrent(), __ATOMIC_RELEASE);
+    for (size_t i = 0; i < workQueue.numWorkers; i++) {
+        HAPPlatformWork* _Nullable stopRequest = NULL;
+        xQueueSend(workQueue.queue, &stopRequest, portMAX_DELAY);
+    }
+    for (size_t i = 0; i < workQueue.numWorkers; i++) {
+        xSemaphoreTake(workQueue.stoppedWorkers, portMAX_DELAY);
+    }
+
+    // Parked work items are in reverse order of execution.
+    HAPPlatformWork* _Nullable completedWork = NULL;
+    while (workQueue.parkedWork) {
+        HAPPlatformWork* work = HAPNonnull(workQueue.parkedWork);
+        workQueue.parkedWork = work->nextWork;
+        work->nextWork = completedWork;
+        completedWork = work;
+    }
+
+    vQueueDelete(workQueue.queue);
+    vSemaphoreDelete(workQueue.stoppedWorkers);
+    HAPRawBufferZero(&workQueue, sizeof workQueue);
+
+    while (completedWork) {
+        HAPPlatformWork* work = HAPNonnull(completedWork);
+        completedWork = work->nextWork;
+        work->nextWork = NULL;
+        HandleWorkCompletedCallback(work, sizeof *work);
+    }
+}
+
+HAP_RESULT_USE_CHECK
+HAPError HAPPlatformWorkSubmit(
+        HAPPlatformWork* work,
+        HAPPlatformWorkCallback callback,
+        HAPPlatformWorkCompletionCallback completionCallback,
+        void* _Nullable context) {
+    HAPPrecondition(work);
+    HAPPrecondition(!work->callback);
+    HAPPrecondition(callback);
+    HAPPrecondition(completionCallback);
+    HAPPrecondition(workQueue.queue);
+
+    if (__atomic_add_fetch(&workQueue.numPendingWork, 1, __ATOMIC_RELAXED) > workQueue.maxPendingWork) {
+        __atomic_sub_fetch(&workQueue.numPendingWork, 1, __ATOMIC_RELAXED);
+        HAPLog(&logObject, "Too many pending work items.");
+        return kHAPError_OutOfResources;
+    }
+
+    work->callback = callback;
+    work->completionCallback = completionCallback;
+    work->context = context;
+    work->runLoop = HAPPlatformRunLoopGetCurrent();
+
+    // The queue has room for maxPendingWork work items in addition to the stop requests.
+    BaseType_t ok = xQueueSend(workQueue.queue, &work, 0);
+    HAPAssert(ok == pdTRUE);
+    return kHAPError_None;
+}
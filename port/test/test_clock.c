@@ -0,0 +1,89 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+
+#include "unity.h"
+
+#include "HAPPlatform.h"
+#include "HAPPlatform+Init.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformKeyValueStore+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+
+#if HAVE_VIRTUAL_CLOCK
+
+/**
+ * Number of chained one-second timers that are replayed.
+ */
+#define kVirtualClockTest_NumTimers ((size_t) 3600)
+
+/**
+ * Upper bound for the wall-clock duration of the replay, in microseconds.
+ */
+#define kVirtualClockTest_MaxDuration ((uint64_t) 1000000)
+
+static size_t numExpiredTimers;
+
+static void HandleTimerExpired(HAPPlatformTimerRef timer HAP_UNUSED, void* _Nullable context HAP_UNUSED) {
+    numExpiredTimers++;
+    if (numExpiredTimers == kVirtualClockTest_NumTimers) {
+        HAPPlatformRunLoopStop();
+        return;
+    }
+
+    HAPPlatformTimerRef nextTimer;
+    HAPError err =
+            HAPPlatformTimerRegister(&nextTimer, HAPPlatformClockGetCurrent() + 1000, HandleTimerExpired, NULL);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+}
+
+TEST_CASE("cached loop time is kept at any virtual time", "[clock]") {
+    HAPPlatformClockUpdateLoopTime();
+    HAPTime loopTime = HAPPlatformClockGetLoopTime();
+    TEST_ASSERT_EQUAL(HAPPlatformClockGetCurrent(), loopTime);
+
+    // The cached time is only refreshed by the run loop, also if it is 0.
+    HAPPlatformClockAdvanceVirtualTime(5);
+    TEST_ASSERT_EQUAL(loopTime, HAPPlatformClockGetLoopTime());
+    TEST_ASSERT_EQUAL(loopTime + 5, HAPPlatformClockUpdateLoopTime());
+}
+
+TEST_CASE("one hour of one-second timers is replayed without waiting", "[clock][run_loop]") {
+    static HAPPlatformKeyValueStore keyValueStore;
+    HAPPlatformRunLoopRef runLoop;
+    HAPError err = HAPPlatformRunLoopCreateInstance(
+            &runLoop, &(const HAPPlatformRunLoopOptions) { .keyValueStore = &keyValueStore });
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+    HAPPlatformRunLoopSetCurrent(runLoop);
+
+    numExpiredTimers = 0;
+    HAPTime startTime = HAPPlatformClockGetCurrent();
+    HAPPlatformTimerRef timer;
+    err = HAPPlatformTimerRegister(&timer, startTime + 1000, HandleTimerExpired, NULL);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+
+    uint64_t wallStartTime = HAPPlatformClockGetCurrentMicroseconds();
+    HAPPlatformRunLoopRun();
+    uint64_t duration = HAPPlatformClockGetCurrentMicroseconds() - wallStartTime;
+    printf("%zu timers: %llu us\n", kVirtualClockTest_NumTimers, (unsigned long long) duration);
+
+    TEST_ASSERT_EQUAL(kVirtualClockTest_NumTimers, numExpiredTimers);
+    TEST_ASSERT_EQUAL(startTime + kVirtualClockTest_NumTimers * 1000, HAPPlatformClockGetCurrent());
+    TEST_ASSERT_TRUE(duration < kVirtualClockTest_MaxDuration);
+
+    HAPPlatformRunLoopReleaseInstance(runLoop);
+}
+
+#endif
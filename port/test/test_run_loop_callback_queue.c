@@ -0,0 +1,310 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "unity.h"
+
+#include "HAPPlatform.h"
+#include "HAPPlatform+Init.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformKeyValueStore+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+
+/**
+ * Number of times the scheduled callback queue is refilled. Each round starts at a different ring offset.
+ */
+#define kQueueTest_NumRounds ((size_t) 100)
+
+typedef struct {
+    uint32_t capacity;
+    uint32_t numScheduled;
+    uint32_t numInvoked;
+    size_t numRounds;
+    HAPPlatformTimerRef guardTimer;
+} QueueTest;
+
+static QueueTest queueTest;
+
+static HAPPlatformRunLoopRef CreateRunLoop(void) {
+    static HAPPlatformKeyValueStore keyValueStore;
+    HAPPlatformRunLoopRef runLoop;
+    HAPError err = HAPPlatformRunLoopCreateInstance(
+            &runLoop, &(const HAPPlatformRunLoopOptions) { .keyValueStore = &keyValueStore });
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+    HAPPlatformRunLoopSetCurrent(runLoop);
+    return runLoop;
+}
+
+static void HandleGuardTimerExpired(HAPPlatformTimerRef timer HAP_UNUSED, void* _Nullable context HAP_UNUSED) {
+    queueTest.guardTimer = 0;
+    HAPPlatformRunLoopStop();
+}
+
+static void RegisterGuardTimer(void) {
+    // Stops the run loop if an expected callback is not invoked.
+    HAPError err = HAPPlatformTimerRegister(
+            &queueTest.guardTimer, HAPPlatformClockGetCurrent() + 5000, HandleGuardTimerExpired, NULL);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+}
+
+static void StopTest(void) {
+    HAPPlatformTimerDeregister(queueTest.guardTimer);
+    queueTest.guardTimer = 0;
+    HAPPlatformRunLoopStop();
+}
+
+static void HandleNumberedCallback(void* _Nullable context, size_t contextSize);
+
+/**
+ * Schedules numbered callbacks until the scheduled callback queue is full.
+ *
+ * @return Number of callbacks that have been scheduled.
+ */
+static uint32_t FillQueue(void) {
+    uint32_t numScheduled = 0;
+    for (;;) {
+        uint32_t sequenceNumber = queueTest.numScheduled;
+        HAPError err =
+                HAPPlatformRunLoopScheduleCallback(HandleNumberedCallback, &sequenceNumber, sizeof sequenceNumber);
+        if (err) {
+            TEST_ASSERT_EQUAL(kHAPError_OutOfResources, err);
+            return numScheduled;
+        }
+        queueTest.numScheduled++;
+        numScheduled++;
+    }
+}
+
+static void HandleNumberedCallback(void* _Nullable context, size_t contextSize) {
+    TEST_ASSERT_EQUAL(sizeof(uint32_t), contextSize);
+    uint32_t sequenceNumber;
+    memcpy(&sequenceNumber, context, sizeof sequenceNumber);
+    TEST_ASSERT_EQUAL(queueTest.numInvoked, sequenceNumber);
+    queueTest.numInvoked++;
+
+    if (queueTest.numInvoked != queueTest.numScheduled) {
+        return;
+    }
+    if (queueTest.numRounds == kQueueTest_NumRounds) {
+        StopTest();
+        return;
+    }
+
+    // The slot of the callback that is being invoked is released after it returns.
+    queueTest.numRounds++;
+    TEST_ASSERT_EQUAL(queueTest.capacity - 1, FillQueue());
+}
+
+TEST_CASE("scheduled callbacks are invoked in order across queue wrap-around", "[run_loop][callback]") {
+    HAPPlatformRunLoopRef runLoop = CreateRunLoop();
+    HAPRawBufferZero(&queueTest, sizeof queueTest);
+
+    // The queue accepts exactly its capacity, which is a power of two.
+    queueTest.capacity = FillQueue();
+    TEST_ASSERT_TRUE(queueTest.capacity >= 2);
+    TEST_ASSERT_EQUAL(0, queueTest.capacity & (queueTest.capacity - 1));
+
+    RegisterGuardTimer();
+    HAPPlatformRunLoopRun();
+    TEST_ASSERT_EQUAL(kQueueTest_NumRounds, queueTest.numRounds);
+    TEST_ASSERT_EQUAL(queueTest.numScheduled, queueTest.numInvoked);
+    TEST_ASSERT_EQUAL(queueTest.capacity + kQueueTest_NumRounds * (queueTest.capacity - 1), queueTest.numInvoked);
+
+    HAPPlatformRunLoopReleaseInstance(runLoop);
+}
+
+/**
+ * Maximum number of times the starvation test callback reschedules itself.
+ */
+#define kStarvationTest_MaxInvocations ((uint32_t) 10000000)
+
+typedef struct {
+    uint32_t numInvocations;
+    bool isTimerExpired;
+} StarvationTest;
+
+static StarvationTest starvationTest;
+
+static void HandleReschedulingCallback(void* _Nullable context HAP_UNUSED, size_t contextSize HAP_UNUSED) {
+    starvationTest.numInvocations++;
+    if (starvationTest.isTimerExpired || starvationTest.numInvocations == kStarvationTest_MaxInvocations) {
+        StopTest();
+        return;
+    }
+    HAPError err = HAPPlatformRunLoopScheduleCallback(HandleReschedulingCallback, NULL, 0);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+}
+
+static void HandleStarvationTimerExpired(HAPPlatformTimerRef timer HAP_UNUSED, void* _Nullable context HAP_UNUSED) {
+    starvationTest.isTimerExpired = true;
+}
+
+TEST_CASE("a callback that reschedules itself does not starve timers", "[run_loop][callback]") {
+    HAPPlatformRunLoopRef runLoop = CreateRunLoop();
+    HAPRawBufferZero(&queueTest, sizeof queueTest);
+    HAPRawBufferZero(&starvationTest, sizeof starvationTest);
+
+    HAPPlatformTimerRef timer;
+    HAPError err = HAPPlatformTimerRegister(
+            &timer, HAPPlatformClockGetCurrent() + 10, HandleStarvationTimerExpired, NULL);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+    err = HAPPlatformRunLoopScheduleCallback(HandleReschedulingCallback, NULL, 0);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+
+    RegisterGuardTimer();
+    HAPPlatformRunLoopRun();
+
+    // Callbacks that are scheduled while the queue is drained are invoked in a later run loop iteration.
+    TEST_ASSERT_TRUE(starvationTest.isTimerExpired);
+    TEST_ASSERT_TRUE(starvationTest.numInvocations < kStarvationTest_MaxInvocations);
+
+    HAPPlatformRunLoopReleaseInstance(runLoop);
+}
+
+/**
+ * Number of callbacks that are scheduled by the budget test.
+ */
+#define kBudgetTest_NumCallbacks ((uint32_t) 10)
+
+typedef struct {
+    uint32_t numInvocations;
+    uint32_t numInvocationsWhenTimerExpired;
+} BudgetTest;
+
+static BudgetTest budgetTest;
+
+static void HandleBusyCallback(void* _Nullable context HAP_UNUSED, size_t contextSize HAP_UNUSED) {
+    // Each callback exhausts the dispatch budget on its own.
+    uint64_t startTime = HAPPlatformClockGetCurrentMicroseconds();
+    while (HAPPlatformClockGetCurrentMicroseconds() - startTime < 2000) {
+    }
+    budgetTest.numInvocations++;
+    if (budgetTest.numInvocations == kBudgetTest_NumCallbacks) {
+        StopTest();
+    }
+}
+
+static void HandleBudgetTimerExpired(HAPPlatformTimerRef timer HAP_UNUSED, void* _Nullable context HAP_UNUSED) {
+    budgetTest.numInvocationsWhenTimerExpired = budgetTest.numInvocations;
+}
+
+TEST_CASE("scheduled callbacks share the file handle dispatch budget", "[run_loop][callback]") {
+    static HAPPlatformKeyValueStore keyValueStore;
+    HAPPlatformRunLoopRef runLoop;
+    HAPError err = HAPPlatformRunLoopCreateInstance(
+            &runLoop,
+            &(const HAPPlatformRunLoopOptions) { .keyValueStore = &keyValueStore, .fileHandleDispatchBudget = 1 });
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+    HAPPlatformRunLoopSetCurrent(runLoop);
+    HAPRawBufferZero(&queueTest, sizeof queueTest);
+    HAPRawBufferZero(&budgetTest, sizeof budgetTest);
+
+    for (uint32_t i = 0; i < kBudgetTest_NumCallbacks; i++) {
+        err = HAPPlatformRunLoopScheduleCallback(HandleBusyCallback, NULL, 0);
+        TEST_ASSERT_EQUAL(kHAPError_None, err);
+    }
+    HAPPlatformTimerRef timer;
+    err = HAPPlatformTimerRegister(&timer, HAPPlatformClockGetCurrent() + 5, HandleBudgetTimerExpired, NULL);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+
+    RegisterGuardTimer();
+    HAPPlatformRunLoopRun();
+
+    // The timer expires while scheduled callbacks are still queued, as they are spread over several iterations.
+    TEST_ASSERT_EQUAL(kBudgetTest_NumCallbacks, budgetTest.numInvocations);
+    TEST_ASSERT_TRUE(budgetTest.numInvocationsWhenTimerExpired > 0);
+    TEST_ASSERT_TRUE(budgetTest.numInvocationsWhenTimerExpired < kBudgetTest_NumCallbacks);
+#if HAVE_RUN_LOOP_STATISTICS
+    HAPPlatformRunLoopStatistics statistics;
+    HAPPlatformRunLoopGetStatistics(&statistics);
+    TEST_ASSERT_EQUAL(kBudgetTest_NumCallbacks - 1, statistics.numDeferredScheduledCallbackDispatches);
+#endif
+
+    HAPPlatformRunLoopReleaseInstance(runLoop);
+}
+
+/**
+ * Maximum number of callbacks that are invoked by the coalescing test.
+ */
+#define kCoalescingTest_MaxInvocations ((size_t) 16)
+
+typedef struct {
+    uint32_t values[kCoalescingTest_MaxInvocations];
+    size_t numValues;
+} CoalescingTest;
+
+static CoalescingTest coalescingTest;
+
+static void HandleValueCallback(void* _Nullable context, size_t contextSize) {
+    TEST_ASSERT_EQUAL(sizeof(uint32_t), contextSize);
+    TEST_ASSERT_TRUE(coalescingTest.numValues < kCoalescingTest_MaxInvocations);
+    memcpy(&coalescingTest.values[coalescingTest.numValues], context, sizeof(uint32_t));
+    coalescingTest.numValues++;
+}
+
+static void HandleStopCallback(void* _Nullable context HAP_UNUSED, size_t contextSize HAP_UNUSED) {
+    StopTest();
+}
+
+static void ScheduleValue(HAPPlatformRunLoopCallbackPriority priority, uint32_t coalescingKey, uint32_t value) {
+    HAPError err = HAPPlatformRunLoopScheduleCallbackWithOptions(
+            HandleValueCallback,
+            &value,
+            sizeof value,
+            &(const HAPPlatformRunLoopScheduleOptions) { .priority = priority, .coalescingKey = coalescingKey });
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+}
+
+TEST_CASE("only the latest queued callback with a coalescing key is invoked", "[run_loop][callback]") {
+    HAPPlatformRunLoopRef runLoop = CreateRunLoop();
+    HAPRawBufferZero(&queueTest, sizeof queueTest);
+    HAPRawBufferZero(&coalescingTest, sizeof coalescingTest);
+
+    // Callbacks without a key are never dropped. Keys only coalesce within the queue of one priority.
+    ScheduleValue(kHAPPlatformRunLoopCallbackPriority_Normal, 1, 1);
+    ScheduleValue(kHAPPlatformRunLoopCallbackPriority_Normal, 0, 2);
+    ScheduleValue(kHAPPlatformRunLoopCallbackPriority_Normal, 2, 3);
+    ScheduleValue(kHAPPlatformRunLoopCallbackPriority_Normal, 1, 4);
+    ScheduleValue(kHAPPlatformRunLoopCallbackPriority_Normal, 0, 5);
+    ScheduleValue(kHAPPlatformRunLoopCallbackPriority_Normal, 1, 6);
+    ScheduleValue(kHAPPlatformRunLoopCallbackPriority_Urgent, 1, 7);
+    HAPError err = HAPPlatformRunLoopScheduleCallback(HandleStopCallback, NULL, 0);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+
+    RegisterGuardTimer();
+    HAPPlatformRunLoopRun();
+
+    // Urgent callbacks run first. Superseded callbacks are dropped, and the latest one keeps its position.
+    const uint32_t expectedValues[] = { 7, 2, 3, 5, 6 };
+    TEST_ASSERT_EQUAL(HAPArrayCount(expectedValues), coalescingTest.numValues);
+    TEST_ASSERT_EQUAL_MEMORY(expectedValues, coalescingTest.values, sizeof expectedValues);
+#if HAVE_RUN_LOOP_STATISTICS
+    HAPPlatformRunLoopStatistics statistics;
+    HAPPlatformRunLoopGetStatistics(&statistics);
+    TEST_ASSERT_EQUAL(2, statistics.numCoalescedCallbacks);
+#endif
+
+    // Callbacks with the same key are not coalesced once the older one has been invoked.
+    coalescingTest.numValues = 0;
+    ScheduleValue(kHAPPlatformRunLoopCallbackPriority_Normal, 1, 8);
+    err = HAPPlatformRunLoopScheduleCallback(HandleStopCallback, NULL, 0);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+    RegisterGuardTimer();
+    HAPPlatformRunLoopRun();
+    TEST_ASSERT_EQUAL(1, coalescingTest.numValues);
+    TEST_ASSERT_EQUAL(8, coalescingTest.values[0]);
+
+    HAPPlatformRunLoopReleaseInstance(runLoop);
+}
@@ -0,0 +1,228 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Tests of the I/O multiplexer backend. The benchmark passes one datagram at a time around a ring of registered UDP
+// sockets, so every run loop iteration waits with all file handles registered and exactly one of them ready.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "unity.h"
+
+#include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformFileHandle.h"
+#include "HAPPlatformKeyValueStore+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+
+/**
+ * Number of events that are dispatched per benchmark run.
+ */
+#define kBenchmark_NumEvents ((size_t) 10000)
+
+typedef struct Benchmark Benchmark;
+
+typedef struct {
+    Benchmark* benchmark;
+    size_t index;
+    int fileDescriptor;
+    struct sockaddr_in address;
+    HAPPlatformFileHandleRef fileHandle;
+} BenchmarkSocket;
+
+struct Benchmark {
+    BenchmarkSocket* sockets;
+    size_t numSockets;
+    int sendFileDescriptor;
+    size_t numEvents;
+};
+
+static void SendToSocket(Benchmark* benchmark, size_t index) {
+    const BenchmarkSocket* socket = &benchmark->sockets[index];
+    uint8_t byte = 0;
+    ssize_t n = sendto(
+            benchmark->sendFileDescriptor,
+            &byte,
+            sizeof byte,
+            0,
+            (const struct sockaddr*) &socket->address,
+            sizeof socket->address);
+    TEST_ASSERT_EQUAL(sizeof byte, n);
+}
+
+static void HandleSocketReady(
+        HAPPlatformFileHandleRef fileHandle HAP_UNUSED,
+        HAPPlatformFileHandleEvent fileHandleEvents,
+        void* _Nullable context) {
+    BenchmarkSocket* socket = context;
+    Benchmark* benchmark = socket->benchmark;
+    TEST_ASSERT_TRUE(fileHandleEvents.isReadyForReading);
+
+    uint8_t byte;
+    ssize_t n = recv(socket->fileDescriptor, &byte, sizeof byte, 0);
+    TEST_ASSERT_EQUAL(sizeof byte, n);
+
+    benchmark->numEvents++;
+    if (benchmark->numEvents == kBenchmark_NumEvents) {
+        HAPPlatformRunLoopStop();
+        return;
+    }
+    // Stride through the ring so that the ready file descriptor is spread over the whole set.
+    SendToSocket(benchmark, (socket->index + 7) % benchmark->numSockets);
+}
+
+/**
+ * Opens a non-blocking UDP socket bound to an ephemeral loopback port.
+ *
+ * @return File descriptor, or -1 if the socket could not be opened.
+ */
+static int OpenSocket(struct sockaddr_in* address) {
+    int fileDescriptor = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fileDescriptor < 0) {
+        return -1;
+    }
+    memset(address, 0, sizeof *address);
+    address->sin_family = AF_INET;
+    address->sin_port = htons(0);
+    address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof *address;
+    if (bind(fileDescriptor, (struct sockaddr*) address, sizeof *address) < 0 ||
+        getsockname(fileDescriptor, (struct sockaddr*) address, &addressLength) < 0) {
+        close(fileDescriptor);
+        return -1;
+    }
+    return fileDescriptor;
+}
+
+static void RunBenchmark(size_t numSockets) {
+    static HAPPlatformKeyValueStore keyValueStore;
+    HAPPlatformRunLoopRef runLoop;
+    HAPError err = HAPPlatformRunLoopCreateInstance(
+            &runLoop, &(const HAPPlatformRunLoopOptions) { .keyValueStore = &keyValueStore });
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+    HAPPlatformRunLoopSetCurrent(runLoop);
+
+    Benchmark benchmark = { .numSockets = 0, .numEvents = 0 };
+    benchmark.sockets = calloc(numSockets, sizeof *benchmark.sockets);
+    TEST_ASSERT_NOT_NULL(benchmark.sockets);
+    struct sockaddr_in sendAddress;
+    benchmark.sendFileDescriptor = OpenSocket(&sendAddress);
+    TEST_ASSERT_TRUE(benchmark.sendFileDescriptor >= 0);
+
+    // Socket and file descriptor limits differ between targets. Sizes that do not fit are skipped.
+    for (size_t i = 0; i < numSockets; i++) {
+        BenchmarkSocket* socket = &benchmark.sockets[i];
+        socket->benchmark = &benchmark;
+        socket->index = i;
+        socket->fileDescriptor = OpenSocket(&socket->address);
+        if (socket->fileDescriptor < 0) {
+            break;
+        }
+        err = HAPPlatformFileHandleRegister(
+                &socket->fileHandle,
+                socket->fileDescriptor,
+                (HAPPlatformFileHandleEvent) { .isReadyForReading = true },
+                HandleSocketReady,
+                socket);
+        if (err) {
+            close(socket->fileDescriptor);
+            break;
+        }
+        benchmark.numSockets++;
+    }
+
+    uint64_t duration = 0;
+    if (benchmark.numSockets == numSockets) {
+        uint64_t startTime = HAPPlatformClockGetCurrentMicroseconds();
+        SendToSocket(&benchmark, 0);
+        HAPPlatformRunLoopRun();
+        duration = HAPPlatformClockGetCurrentMicroseconds() - startTime;
+        TEST_ASSERT_EQUAL(kBenchmark_NumEvents, benchmark.numEvents);
+    }
+
+    for (size_t i = 0; i < benchmark.numSockets; i++) {
+        HAPPlatformFileHandleDeregister(benchmark.sockets[i].fileHandle);
+        close(benchmark.sockets[i].fileDescriptor);
+    }
+    close(benchmark.sendFileDescriptor);
+    free(benchmark.sockets);
+    HAPPlatformRunLoopReleaseInstance(runLoop);
+
+    if (benchmark.numSockets != numSockets) {
+        printf("%zu file handles: skipped, only %zu could be registered\n", numSockets, benchmark.numSockets);
+        TEST_IGNORE_MESSAGE("Not enough sockets.");
+    }
+    printf("%zu file handles: %llu ns per event\n",
+           numSockets,
+           (unsigned long long) (duration * 1000 / kBenchmark_NumEvents));
+}
+
+TEST_CASE("multiplexer dispatch with 8 file handles", "[run_loop][perf]") {
+    RunBenchmark(8);
+}
+
+TEST_CASE("multiplexer dispatch with 64 file handles", "[run_loop][perf]") {
+    RunBenchmark(64);
+}
+
+TEST_CASE("multiplexer dispatch with 1024 file handles", "[run_loop][perf]") {
+    RunBenchmark(1024);
+}
+
+static void HandleUnexpectedEvent(
+        HAPPlatformFileHandleRef fileHandle HAP_UNUSED,
+        HAPPlatformFileHandleEvent fileHandleEvents HAP_UNUSED,
+        void* _Nullable context HAP_UNUSED) {
+    TEST_FAIL_MESSAGE("Unexpected file handle event.");
+}
+
+TEST_CASE("registering a file descriptor twice fails", "[run_loop]") {
+    static HAPPlatformKeyValueStore keyValueStore;
+    HAPPlatformRunLoopRef runLoop;
+    HAPError err = HAPPlatformRunLoopCreateInstance(
+            &runLoop, &(const HAPPlatformRunLoopOptions) { .keyValueStore = &keyValueStore });
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+    HAPPlatformRunLoopSetCurrent(runLoop);
+
+    struct sockaddr_in address;
+    int fileDescriptor = OpenSocket(&address);
+    TEST_ASSERT_TRUE(fileDescriptor >= 0);
+
+    // Duplicates are detected both with and without interests.
+    const HAPPlatformFileHandleEvent interests[] = { { .isReadyForReading = false }, { .isReadyForReading = true } };
+    for (size_t i = 0; i < HAPArrayCount(interests); i++) {
+        HAPPlatformFileHandleRef fileHandle;
+        err = HAPPlatformFileHandleRegister(&fileHandle, fileDescriptor, interests[i], HandleUnexpectedEvent, NULL);
+        TEST_ASSERT_EQUAL(kHAPError_None, err);
+
+        HAPPlatformFileHandleRef duplicateFileHandle;
+        err = HAPPlatformFileHandleRegister(
+                &duplicateFileHandle, fileDescriptor, interests[i], HandleUnexpectedEvent, NULL);
+        TEST_ASSERT_EQUAL(kHAPError_InvalidState, err);
+        TEST_ASSERT_EQUAL(0, duplicateFileHandle);
+
+        // The file descriptor can be registered again once the original registration has been removed.
+        HAPPlatformFileHandleDeregister(fileHandle);
+        err = HAPPlatformFileHandleRegister(&fileHandle, fileDescriptor, interests[i], HandleUnexpectedEvent, NULL);
+        TEST_ASSERT_EQUAL(kHAPError_None, err);
+        HAPPlatformFileHandleDeregister(fileHandle);
+    }
+
+    close(fileDescriptor);
+    HAPPlatformRunLoopReleaseInstance(runLoop);
+}
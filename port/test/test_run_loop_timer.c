@@ -0,0 +1,202 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+
+#include "unity.h"
+
+#include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformKeyValueStore+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+
+/**
+ * Number of timers that are registered by the ordering tests.
+ */
+#define kTimerTest_NumTimers ((size_t) 200)
+
+/**
+ * Number of distinct deadlines. Smaller than the number of timers, so that many timers share a deadline.
+ */
+#define kTimerTest_NumDeadlines ((uint32_t) 40)
+
+typedef struct {
+    HAPPlatformTimerRef timers[kTimerTest_NumTimers];
+    HAPTime deadlines[kTimerTest_NumTimers];
+    bool isDeregistered[kTimerTest_NumTimers];
+    size_t firedTimers[kTimerTest_NumTimers];
+    size_t numFiredTimers;
+    size_t numExpectedTimers;
+    HAPPlatformTimerRef guardTimer;
+} TimerTest;
+
+typedef struct {
+    TimerTest* test;
+    size_t index;
+} TimerTestContext;
+
+static TimerTest timerTest;
+static TimerTestContext timerTestContexts[kTimerTest_NumTimers];
+
+/**
+ * Deterministic pseudo-random number generator, so that failures are reproducible.
+ */
+static uint32_t NextRandom(uint32_t* state) {
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+static HAPPlatformRunLoopRef CreateRunLoop(void) {
+    static HAPPlatformKeyValueStore keyValueStore;
+    HAPPlatformRunLoopRef runLoop;
+    HAPError err = HAPPlatformRunLoopCreateInstance(
+            &runLoop, &(const HAPPlatformRunLoopOptions) { .keyValueStore = &keyValueStore });
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+    HAPPlatformRunLoopSetCurrent(runLoop);
+    return runLoop;
+}
+
+static void HandleGuardTimerExpired(HAPPlatformTimerRef timer HAP_UNUSED, void* _Nullable context) {
+    TimerTest* test = context;
+    test->guardTimer = 0;
+    HAPPlatformRunLoopStop();
+}
+
+static void HandleTimerExpired(HAPPlatformTimerRef timer, void* _Nullable context) {
+    TimerTestContext* timerContext = context;
+    TimerTest* test = timerContext->test;
+    size_t index = timerContext->index;
+
+    TEST_ASSERT_EQUAL(test->timers[index], timer);
+    TEST_ASSERT_FALSE(test->isDeregistered[index]);
+    TEST_ASSERT_TRUE(HAPPlatformClockGetCurrent() >= test->deadlines[index]);
+    TEST_ASSERT_TRUE(test->numFiredTimers < kTimerTest_NumTimers);
+    test->firedTimers[test->numFiredTimers++] = index;
+
+    if (test->numFiredTimers == test->numExpectedTimers) {
+        HAPPlatformTimerDeregister(test->guardTimer);
+        test->guardTimer = 0;
+        HAPPlatformRunLoopStop();
+    }
+}
+
+/**
+ * Registers the test timers with pseudo-random deadlines, many of which are shared.
+ */
+static void RegisterTimers(TimerTest* test) {
+    HAPRawBufferZero(test, sizeof *test);
+    uint32_t state = 1;
+    HAPTime now = HAPPlatformClockGetCurrent();
+    for (size_t i = 0; i < kTimerTest_NumTimers; i++) {
+        timerTestContexts[i].test = test;
+        timerTestContexts[i].index = i;
+        test->deadlines[i] = now + 10 + NextRandom(&state) % kTimerTest_NumDeadlines;
+        HAPError err = HAPPlatformTimerRegister(
+                &test->timers[i], test->deadlines[i], HandleTimerExpired, &timerTestContexts[i]);
+        TEST_ASSERT_EQUAL(kHAPError_None, err);
+        TEST_ASSERT_TRUE(test->timers[i] != 0);
+    }
+    test->numExpectedTimers = kTimerTest_NumTimers;
+
+    // Stops the run loop if an expected timer does not fire.
+    HAPError err = HAPPlatformTimerRegister(&test->guardTimer, now + 1000, HandleGuardTimerExpired, test);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+}
+
+/**
+ * Checks that the timers fired in order of their deadlines, and timers with the same deadline in order of
+ * registration.
+ */
+static void CheckFiringOrder(const TimerTest* test) {
+    TEST_ASSERT_EQUAL(test->numExpectedTimers, test->numFiredTimers);
+    for (size_t i = 1; i < test->numFiredTimers; i++) {
+        size_t previousIndex = test->firedTimers[i - 1];
+        size_t index = test->firedTimers[i];
+        TEST_ASSERT_TRUE(test->deadlines[previousIndex] <= test->deadlines[index]);
+        if (test->deadlines[previousIndex] == test->deadlines[index]) {
+            TEST_ASSERT_TRUE(previousIndex < index);
+        }
+    }
+}
+
+TEST_CASE("timers fire in deadline order and in registration order on ties", "[run_loop][timer]") {
+    HAPPlatformRunLoopRef runLoop = CreateRunLoop();
+
+    RegisterTimers(&timerTest);
+    HAPPlatformRunLoopRun();
+    CheckFiringOrder(&timerTest);
+
+    HAPPlatformRunLoopReleaseInstance(runLoop);
+}
+
+TEST_CASE("timers removed from the middle of the heap do not fire", "[run_loop][timer]") {
+    HAPPlatformRunLoopRef runLoop = CreateRunLoop();
+
+    RegisterTimers(&timerTest);
+    for (size_t i = 1; i < kTimerTest_NumTimers; i += 3) {
+        HAPPlatformTimerDeregister(timerTest.timers[i]);
+        timerTest.isDeregistered[i] = true;
+        timerTest.numExpectedTimers--;
+    }
+    HAPPlatformRunLoopRun();
+    CheckFiringOrder(&timerTest);
+
+    // A new timer reuses a freed slot. Deregistering the stale references of expired and deregistered timers must not
+    // affect it.
+    HAPError err = HAPPlatformTimerRegister(
+            &timerTest.guardTimer, HAPPlatformClockGetCurrent() + 10, HandleGuardTimerExpired, &timerTest);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+    for (size_t i = 0; i < kTimerTest_NumTimers; i++) {
+        TEST_ASSERT_TRUE(timerTest.timers[i] != timerTest.guardTimer);
+        HAPPlatformTimerDeregister(timerTest.timers[i]);
+    }
+    HAPPlatformRunLoopRun();
+    TEST_ASSERT_EQUAL(0, timerTest.guardTimer);
+
+    HAPPlatformRunLoopReleaseInstance(runLoop);
+}
+
+TEST_CASE("timer churn with 10000 registered timers", "[run_loop][timer][perf]") {
+    enum { kNumTimers = 10000, kNumOperations = 100000 };
+
+    HAPPlatformRunLoopRef runLoop = CreateRunLoop();
+
+    static HAPPlatformTimerRef timers[kNumTimers];
+    uint32_t state = 1;
+    HAPTime now = HAPPlatformClockGetCurrent();
+    for (size_t i = 0; i < kNumTimers; i++) {
+        HAPError err = HAPPlatformTimerRegister(
+                &timers[i], now + 3600000 + NextRandom(&state) % 3600000, HandleGuardTimerExpired, NULL);
+        TEST_ASSERT_EQUAL(kHAPError_None, err);
+    }
+
+    // Each operation deregisters a random timer, i.e., usually one in the middle of the heap, and registers a new one.
+    uint64_t startTime = HAPPlatformClockGetCurrentMicroseconds();
+    for (size_t i = 0; i < kNumOperations; i++) {
+        size_t index = NextRandom(&state) % kNumTimers;
+        HAPPlatformTimerDeregister(timers[index]);
+        HAPError err = HAPPlatformTimerRegister(
+                &timers[index], now + 3600000 + NextRandom(&state) % 3600000, HandleGuardTimerExpired, NULL);
+        TEST_ASSERT_EQUAL(kHAPError_None, err);
+    }
+    uint64_t duration = HAPPlatformClockGetCurrentMicroseconds() - startTime;
+    printf("%d timers: %llu ns per deregister and register\n",
+           kNumTimers,
+           (unsigned long long) (duration * 1000 / kNumOperations));
+
+    for (size_t i = 0; i < kNumTimers; i++) {
+        HAPPlatformTimerDeregister(timers[i]);
+    }
+    HAPPlatformRunLoopReleaseInstance(runLoop);
+}
@@ -0,0 +1,260 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Tests of HAPPlatformTCPStreamWritev. The send and receive buffers are kept small, so that the buffers do not fit
+// into the socket at once and have to be written in several partial writes that end in the middle of a buffer.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "unity.h"
+
+#include "HAPPlatform.h"
+#include "HAPPlatformClock+Init.h"
+#include "HAPPlatformFileHandle.h"
+#include "HAPPlatformKeyValueStore+Init.h"
+#include "HAPPlatformRunLoop+Init.h"
+#include "HAPPlatformTCPStreamManager+Init.h"
+
+/**
+ * Socket buffer size of both ends of the connection, in bytes.
+ */
+#define kWritevTest_SocketBufferSize ((size_t) 4096)
+
+static uint8_t headerBytes[100];
+static uint8_t bodyBytes[40000];
+static uint8_t trailerBytes[10000];
+
+/**
+ * Buffers that are written, in order. The empty buffer must be skipped.
+ */
+static const HAPPlatformTCPStreamWriteBuffer writevTestBuffers[] = {
+    { .bytes = headerBytes, .numBytes = sizeof headerBytes },
+    { .bytes = NULL, .numBytes = 0 },
+    { .bytes = bodyBytes, .numBytes = sizeof bodyBytes },
+    { .bytes = trailerBytes, .numBytes = sizeof trailerBytes },
+};
+
+#define kWritevTest_NumBytes (sizeof headerBytes + sizeof bodyBytes + sizeof trailerBytes)
+
+typedef struct {
+    HAPPlatformTCPStreamManager tcpStreamManager;
+    HAPPlatformTCPStreamRef tcpStream;
+    int clientFileDescriptor;
+    HAPPlatformFileHandleRef clientFileHandle;
+    size_t numBytesWritten;
+    size_t numWrites;
+    size_t numPartialWrites;
+    size_t numBytesReceived;
+    uint8_t receivedBytes[kWritevTest_NumBytes];
+    HAPPlatformTimerRef guardTimer;
+} WritevTest;
+
+static WritevTest writevTest;
+
+/**
+ * Returns the expected byte at an offset of the concatenated buffers.
+ */
+static uint8_t GetExpectedByte(size_t offset) {
+    return (uint8_t)(offset * 7 + offset / 251);
+}
+
+static void FillBuffers(void) {
+    size_t offset = 0;
+    for (size_t i = 0; i < HAPArrayCount(writevTestBuffers); i++) {
+        uint8_t* bytes = (uint8_t*) (uintptr_t) writevTestBuffers[i].bytes;
+        for (size_t j = 0; j < writevTestBuffers[i].numBytes; j++) {
+            bytes[j] = GetExpectedByte(offset++);
+        }
+    }
+    TEST_ASSERT_EQUAL(kWritevTest_NumBytes, offset);
+}
+
+/**
+ * Gets the parts of the buffers that have not been written yet.
+ *
+ * @param[out] buffers              Remaining buffers.
+ *
+ * @return Number of remaining buffers.
+ */
+static size_t GetRemainingBuffers(HAPPlatformTCPStreamWriteBuffer* buffers) {
+    size_t numBuffers = 0;
+    size_t offset = writevTest.numBytesWritten;
+    for (size_t i = 0; i < HAPArrayCount(writevTestBuffers); i++) {
+        if (offset >= writevTestBuffers[i].numBytes) {
+            offset -= writevTestBuffers[i].numBytes;
+            continue;
+        }
+        buffers[numBuffers].bytes = (const uint8_t*) writevTestBuffers[i].bytes + offset;
+        buffers[numBuffers].numBytes = writevTestBuffers[i].numBytes - offset;
+        numBuffers++;
+        offset = 0;
+    }
+    return numBuffers;
+}
+
+static void HandleGuardTimerExpired(HAPPlatformTimerRef timer HAP_UNUSED, void* _Nullable context HAP_UNUSED) {
+    writevTest.guardTimer = 0;
+    HAPPlatformRunLoopStop();
+}
+
+static void HandleTCPStreamEvent(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        HAPPlatformTCPStreamRef tcpStream,
+        HAPPlatformTCPStreamEvent event,
+        void* _Nullable context HAP_UNUSED) {
+    if (!event.hasSpaceAvailable) {
+        return;
+    }
+
+    HAPPlatformTCPStreamWriteBuffer buffers[HAPArrayCount(writevTestBuffers)];
+    size_t numBuffers = GetRemainingBuffers(buffers);
+    size_t numRemainingBytes = kWritevTest_NumBytes - writevTest.numBytesWritten;
+    size_t numBytes;
+    HAPError err = HAPPlatformTCPStreamWritev(tcpStreamManager, tcpStream, buffers, numBuffers, &numBytes);
+    if (err == kHAPError_Busy) {
+        return;
+    }
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+    TEST_ASSERT_TRUE(numBytes <= numRemainingBytes);
+    writevTest.numWrites++;
+    if (numBytes < numRemainingBytes) {
+        writevTest.numPartialWrites++;
+    }
+    writevTest.numBytesWritten += numBytes;
+
+    if (writevTest.numBytesWritten == kWritevTest_NumBytes) {
+        HAPPlatformTCPStreamUpdateInterests(
+                tcpStreamManager, tcpStream, (HAPPlatformTCPStreamEvent) { .hasSpaceAvailable = false }, NULL, NULL);
+    }
+}
+
+static void HandleClientReadable(
+        HAPPlatformFileHandleRef fileHandle HAP_UNUSED,
+        HAPPlatformFileHandleEvent fileHandleEvents,
+        void* _Nullable context HAP_UNUSED) {
+    TEST_ASSERT_TRUE(fileHandleEvents.isReadyForReading);
+
+    for (;;) {
+        size_t maxBytes = kWritevTest_NumBytes - writevTest.numBytesReceived;
+        if (!maxBytes) {
+            break;
+        }
+        ssize_t n = recv(
+                writevTest.clientFileDescriptor, &writevTest.receivedBytes[writevTest.numBytesReceived], maxBytes, 0);
+        if (n < 0) {
+            TEST_ASSERT_TRUE(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+            return;
+        }
+        TEST_ASSERT_TRUE(n > 0);
+        writevTest.numBytesReceived += (size_t) n;
+    }
+
+    HAPPlatformTimerDeregister(writevTest.guardTimer);
+    writevTest.guardTimer = 0;
+    HAPPlatformRunLoopStop();
+}
+
+static void HandlePendingConnection(
+        HAPPlatformTCPStreamManagerRef tcpStreamManager,
+        void* _Nullable context HAP_UNUSED) {
+    HAPError err = HAPPlatformTCPStreamManagerAcceptTCPStream(tcpStreamManager, &writevTest.tcpStream);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+    HAPPlatformTCPStreamUpdateInterests(
+            tcpStreamManager,
+            writevTest.tcpStream,
+            (HAPPlatformTCPStreamEvent) { .hasSpaceAvailable = true },
+            HandleTCPStreamEvent,
+            NULL);
+}
+
+/**
+ * Connects a non-blocking client socket with a small receive buffer to the TCP stream listener.
+ */
+static int ConnectClient(HAPNetworkPort port) {
+    int fileDescriptor = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    TEST_ASSERT_TRUE(fileDescriptor >= 0);
+    int receiveBufferSize = (int) kWritevTest_SocketBufferSize;
+    int e = setsockopt(fileDescriptor, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof receiveBufferSize);
+    TEST_ASSERT_EQUAL(0, e);
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof address);
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    e = connect(fileDescriptor, (const struct sockaddr*) &address, sizeof address);
+    TEST_ASSERT_EQUAL(0, e);
+
+    int flags = fcntl(fileDescriptor, F_GETFL, 0);
+    TEST_ASSERT_TRUE(flags >= 0);
+    e = fcntl(fileDescriptor, F_SETFL, flags | O_NONBLOCK);
+    TEST_ASSERT_EQUAL(0, e);
+    return fileDescriptor;
+}
+
+TEST_CASE("writev resumes partial writes in the middle of a buffer", "[tcp]") {
+    static HAPPlatformKeyValueStore keyValueStore;
+    HAPPlatformRunLoopRef runLoop;
+    HAPError err = HAPPlatformRunLoopCreateInstance(
+            &runLoop, &(const HAPPlatformRunLoopOptions) { .keyValueStore = &keyValueStore });
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+    HAPPlatformRunLoopSetCurrent(runLoop);
+
+    HAPRawBufferZero(&writevTest, sizeof writevTest);
+    FillBuffers();
+
+    HAPPlatformTCPStreamManagerCreate(
+            &writevTest.tcpStreamManager,
+            &(const HAPPlatformTCPStreamManagerOptions) { .port = kHAPNetworkPort_Any,
+                                                          .maxConcurrentTCPStreams = 1,
+                                                          .sendBufferSize = kWritevTest_SocketBufferSize });
+    HAPPlatformTCPStreamManagerOpenListener(&writevTest.tcpStreamManager, HandlePendingConnection, NULL);
+
+    writevTest.clientFileDescriptor =
+            ConnectClient(HAPPlatformTCPStreamManagerGetListenerPort(&writevTest.tcpStreamManager));
+    err = HAPPlatformFileHandleRegister(
+            &writevTest.clientFileHandle,
+            writevTest.clientFileDescriptor,
+            (HAPPlatformFileHandleEvent) { .isReadyForReading = true },
+            HandleClientReadable,
+            NULL);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+
+    err = HAPPlatformTimerRegister(
+            &writevTest.guardTimer, HAPPlatformClockGetCurrent() + 5000, HandleGuardTimerExpired, NULL);
+    TEST_ASSERT_EQUAL(kHAPError_None, err);
+    HAPPlatformRunLoopRun();
+
+    // The data is received in order and complete, although it has been written in several partial writes.
+    TEST_ASSERT_EQUAL(kWritevTest_NumBytes, writevTest.numBytesWritten);
+    TEST_ASSERT_EQUAL(kWritevTest_NumBytes, writevTest.numBytesReceived);
+    for (size_t i = 0; i < kWritevTest_NumBytes; i++) {
+        TEST_ASSERT_EQUAL(GetExpectedByte(i), writevTest.receivedBytes[i]);
+    }
+    TEST_ASSERT_TRUE(writevTest.numPartialWrites > 0);
+    TEST_ASSERT_EQUAL(writevTest.numPartialWrites + 1, writevTest.numWrites);
+
+    HAPPlatformFileHandleDeregister(writevTest.clientFileHandle);
+    close(writevTest.clientFileDescriptor);
+    HAPPlatformTCPStreamClose(&writevTest.tcpStreamManager, writevTest.tcpStream);
+    HAPPlatformTCPStreamManagerCloseListener(&writevTest.tcpStreamManager);
+    HAPPlatformTCPStreamManagerRelease(&writevTest.tcpStreamManager);
+    HAPPlatformRunLoopReleaseInstance(runLoop);
+}